@@ -0,0 +1,287 @@
+#include <Arduino.h>
+#include <TFmini_plus.h>
+
+// Sweeps the lidar through framerates, baudrates and read paths and reports how the driver behaves on this board.
+// Every result line is comma-separated so the log can be parsed straight from the serial monitor:
+//   R,<transport>,<baudrate>,<framerate>,<mode>,<frames>,<expected>,<skipped>,<checksum errors>,<resyncs>,<timeouts>
+//   H,<name>,<unit>,<bucket 0>,<bucket 1>,...
+// Histogram bucket i counts values from 2^i up to 2^(i + 1), except bucket 0 which also counts 0.
+// cost is the time spent in each driver call that returned data, age is the time from a frame's
+// first byte arriving to the driver handing it over, and jitter is how far the gap between frames
+// strays from the frame period.
+//
+// Each framerate change is saved to the lidar's flash, so do not leave this running in a loop.
+
+#if TFMINI_PLUS_PROFILE < TFMINI_PLUS_PROFILE_EXTRAS
+#error "The profiler needs the full driver; build with TFMINI_PLUS_PROFILE_EXTRAS"
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Set to true to profile I2C instead of UART
+const bool PROFILE_I2C = false;
+
+// Use a hardware UART; SoftwareSerial cannot send commands reliably (see Known Issues)
+#define LIDAR_SERIAL Serial1
+const long LIDAR_UART_BAUDRATE = 115200;
+const uint8_t LIDAR_I2C_ADDRESS = 0x10;
+
+const long LOG_SERIAL_BAUD = 115200;
+const unsigned long RUN_TIME = 2000;
+
+const tfminiplus_framerate_t FRAMERATES[] = {TFMINI_PLUS_FRAMERATE_10HZ, TFMINI_PLUS_FRAMERATE_50HZ, TFMINI_PLUS_FRAMERATE_100HZ,
+                                            TFMINI_PLUS_FRAMERATE_250HZ, TFMINI_PLUS_FRAMERATE_500HZ, TFMINI_PLUS_FRAMERATE_1000HZ};
+const tfminiplus_baudrate_t BAUDRATES[] = {TFMINI_PLUS_BAUDRATE_115200, TFMINI_PLUS_BAUDRATE_230400, TFMINI_PLUS_BAUDRATE_460800,
+                                          TFMINI_PLUS_BAUDRATE_921600};
+
+const uint8_t HISTOGRAM_BUCKETS = 20;
+const uint8_t BATCH_SIZE = 16;
+
+typedef enum PROFILER_MODE {
+  MODE_POLL = 0,
+  MODE_LATEST = 1,
+  MODE_READ_FRAMES = 2,
+  MODE_READ_DATA = 3,
+} profiler_mode_t;
+
+const char *const MODE_NAMES[] = {"poll", "latest", "read_frames", "read_data"};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Cortex-M3 and up have a cycle counter in the DWT; everything else is timed with micros()
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+#define TIMER_UNIT "cycles"
+volatile uint32_t *const DWT_CONTROL = (volatile uint32_t *)0xE0001000;
+volatile uint32_t *const DWT_CYCLE_COUNT = (volatile uint32_t *)0xE0001004;
+volatile uint32_t *const DEBUG_EXCEPTION_MONITOR_CONTROL = (volatile uint32_t *)0xE000EDFC;
+
+void start_timer()
+{
+  *DEBUG_EXCEPTION_MONITOR_CONTROL |= 0x01000000;
+  *DWT_CYCLE_COUNT = 0;
+  *DWT_CONTROL |= 1;
+}
+
+uint32_t read_timer() { return *DWT_CYCLE_COUNT; }
+#else
+#define TIMER_UNIT "us"
+void start_timer() {}
+uint32_t read_timer() { return micros(); }
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+TFminiPlus lidar;
+
+uint32_t cost_histogram[HISTOGRAM_BUCKETS];
+uint32_t age_histogram[HISTOGRAM_BUCKETS];
+uint32_t jitter_histogram[HISTOGRAM_BUCKETS];
+uint32_t frames;
+uint32_t skipped;
+uint32_t last_timestamp;
+bool timestamp_primed;
+
+void set_host_baudrate(uint32_t baudrate) { LIDAR_SERIAL.begin(baudrate); }
+
+uint8_t get_bucket(uint32_t value)
+{
+  uint8_t bucket = 0;
+  while (value > 1 and bucket < HISTOGRAM_BUCKETS - 1)
+  {
+    value >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+void reset_run()
+{
+  memset(cost_histogram, 0, sizeof(cost_histogram));
+  memset(age_histogram, 0, sizeof(age_histogram));
+  memset(jitter_histogram, 0, sizeof(jitter_histogram));
+  frames = 0;
+  skipped = 0;
+  timestamp_primed = false;
+  lidar.reset_stats();
+}
+
+void record_frame(const tfminiplus_data_t &data, uint32_t period)
+{
+  frames++;
+  age_histogram[get_bucket(micros() - data.timestamp)]++;
+
+  if (timestamp_primed)
+  {
+    uint32_t interval = data.timestamp - last_timestamp;
+    jitter_histogram[get_bucket(interval > period ? interval - period : period - interval)]++;
+  }
+  last_timestamp = data.timestamp;
+  timestamp_primed = true;
+}
+
+void profile(profiler_mode_t mode, tfminiplus_framerate_t framerate)
+{
+  tfminiplus_data_t batch[BATCH_SIZE];
+  uint32_t period = 1000000UL / framerate;
+
+  reset_run();
+  lidar.set_read_mode(mode == MODE_LATEST ? TFMINI_PLUS_READ_LATEST : TFMINI_PLUS_READ_FIRST);
+
+  unsigned long start_time = millis();
+  while (millis() - start_time < RUN_TIME)
+  {
+    uint32_t call_start = read_timer();
+    size_t count = 0;
+    if (mode == MODE_READ_FRAMES)
+    {
+      count = lidar.read_frames(batch, BATCH_SIZE);
+    }
+    else if (mode == MODE_READ_DATA)
+    {
+      count = lidar.read_data(batch[0], false) ? 1 : 0;
+    }
+    else
+    {
+      count = lidar.poll(batch[0]) ? 1 : 0;
+    }
+    uint32_t cost = read_timer() - call_start;
+    if (count == 0) continue;
+
+    cost_histogram[get_bucket(cost)]++;
+    if (mode == MODE_LATEST) skipped += lidar.get_frames_skipped();
+    for (size_t i = 0; i < count; i++) record_frame(batch[i], period);
+
+    // I2C frames are requested, so pace the requests at the framerate
+    if (mode == MODE_READ_DATA) delay(period / 1000);
+  }
+
+  lidar.set_read_mode(TFMINI_PLUS_READ_FIRST);
+}
+
+void print_histogram(const char *name, const uint32_t *histogram, const char *unit)
+{
+  Serial.print("H,");
+  Serial.print(name);
+  Serial.print(",");
+  Serial.print(unit);
+  for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+  {
+    Serial.print(",");
+    Serial.print(histogram[i]);
+  }
+  Serial.println();
+}
+
+void report(profiler_mode_t mode, uint32_t baudrate, tfminiplus_framerate_t framerate)
+{
+  tfminiplus_stats_t stats = lidar.get_stats();
+  uint32_t expected = (uint32_t(framerate) * RUN_TIME) / 1000;
+
+  Serial.print("R,");
+  Serial.print(PROFILE_I2C ? "i2c" : "uart");
+  Serial.print(",");
+  Serial.print(baudrate);
+  Serial.print(",");
+  Serial.print(framerate);
+  Serial.print(",");
+  Serial.print(MODE_NAMES[mode]);
+  Serial.print(",");
+  Serial.print(frames);
+  Serial.print(",");
+  Serial.print(expected);
+  Serial.print(",");
+  Serial.print(skipped);
+  Serial.print(",");
+  Serial.print(stats.checksum_errors);
+  Serial.print(",");
+  Serial.print(stats.resyncs);
+  Serial.print(",");
+  Serial.println(stats.timeouts);
+
+  print_histogram("cost", cost_histogram, TIMER_UNIT);
+  print_histogram("age", age_histogram, "us");
+  print_histogram("jitter", jitter_histogram, "us");
+}
+
+bool set_framerate(tfminiplus_framerate_t framerate)
+{
+  tfminiplus_settings_t settings = lidar.get_settings();
+  settings.framerate = framerate;
+  return lidar.configure(settings, TFMINI_PLUS_SETTING_FRAMERATE);
+}
+
+void sweep_framerates(uint32_t baudrate)
+{
+  for (uint8_t i = 0; i < sizeof(FRAMERATES) / sizeof(FRAMERATES[0]); i++)
+  {
+    // I2C is limited to 100Hz by the datasheet, and slow baudrates cannot carry the fastest rates
+    uint32_t bits_per_second = uint32_t(FRAMERATES[i]) * TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE * TFMINI_PLUS_UART_BITS_PER_BYTE;
+    if (PROFILE_I2C ? FRAMERATES[i] > TFMINI_PLUS_FRAMERATE_100HZ : bits_per_second > baudrate) continue;
+
+    if (not set_framerate(FRAMERATES[i]))
+    {
+      Serial.print("# Could not set the framerate to ");
+      Serial.println(FRAMERATES[i]);
+      continue;
+    }
+
+    if (PROFILE_I2C)
+    {
+      profile(MODE_READ_DATA, FRAMERATES[i]);
+      report(MODE_READ_DATA, baudrate, FRAMERATES[i]);
+    }
+    else
+    {
+      for (uint8_t mode = MODE_POLL; mode <= MODE_READ_FRAMES; mode++)
+      {
+        profile(profiler_mode_t(mode), FRAMERATES[i]);
+        report(profiler_mode_t(mode), baudrate, FRAMERATES[i]);
+      }
+    }
+  }
+}
+
+void setup()
+{
+  // Start up serial communications
+  Serial.begin(LOG_SERIAL_BAUD);
+  Serial.println("# Started lidar profiler");
+  start_timer();
+
+  if (PROFILE_I2C)
+  {
+    Wire.begin();
+    lidar.begin(LIDAR_I2C_ADDRESS);
+    sweep_framerates(0);
+  }
+  else
+  {
+    LIDAR_SERIAL.begin(LIDAR_UART_BAUDRATE);
+    lidar.begin(&LIDAR_SERIAL);
+    lidar.set_host_baudrate(LIDAR_UART_BAUDRATE);
+
+    tfminiplus_baudrate_t current_baudrate = TFMINI_PLUS_BAUDRATE_115200;
+    for (uint8_t i = 0; i < sizeof(BAUDRATES) / sizeof(BAUDRATES[0]); i++)
+    {
+      if (BAUDRATES[i] != current_baudrate)
+      {
+        if (not lidar.negotiate_baudrate(BAUDRATES[i], current_baudrate, set_host_baudrate))
+        {
+          Serial.print("# Could not switch to ");
+          Serial.println(BAUDRATES[i]);
+          continue;
+        }
+        current_baudrate = BAUDRATES[i];
+      }
+      sweep_framerates(current_baudrate);
+    }
+
+    // Leave the lidar as it was found
+    lidar.negotiate_baudrate(TFMINI_PLUS_BAUDRATE_115200, current_baudrate, set_host_baudrate);
+  }
+
+  set_framerate(TFMINI_PLUS_FRAMERATE_100HZ);
+  Serial.println("# Done");
+}
+
+void loop() {}
@@ -0,0 +1,59 @@
+#ifndef HOST_BENCHMARK_ARDUINO_H
+#define HOST_BENCHMARK_ARDUINO_H
+
+// Minimal stand-in for the Arduino core so the driver can be built and timed on a desktop.
+// Only what the library uses is provided. delay() does not sleep, so blocking waits cost nothing.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+inline unsigned long micros() {
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+inline unsigned long millis() { return micros() / 1000; }
+inline void delay(unsigned long) {}
+inline void delayMicroseconds(unsigned int) {}
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+
+class Print {
+   public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+        size_t written = 0;
+        while (written < size and write(buffer[written])) written++;
+        return written;
+    }
+    virtual void flush() {}
+};
+
+class Stream : public Print {
+   public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(uint8_t *buffer, size_t length) {
+        size_t count = 0;
+        while (count < length) {
+            int c = read();
+            if (c < 0) break;
+            buffer[count++] = c;
+        }
+        return count;
+    }
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef HOST_BENCHMARK_WIRE_H
+#define HOST_BENCHMARK_WIRE_H
+
+#include <Arduino.h>
+
+/**
+ * I2C bus stand-in that answers every read with the next bytes of a capture.
+ * Writes are accepted and ignored.
+ */
+class TwoWire : public Stream {
+   public:
+    TwoWire() : _capture(0), _capture_size(0), _position(0), _available(0) {}
+
+    void replay(const uint8_t *capture, size_t size) {
+        _capture = capture;
+        _capture_size = size;
+        _position = 0;
+        _available = 0;
+    }
+    size_t remaining() const { return _capture_size - _position; }
+
+    void begin() {}
+    void beginTransmission(uint8_t) {}
+    uint8_t endTransmission(bool = true) { return 0; }
+
+    uint8_t requestFrom(uint8_t, uint8_t quantity, bool = true) {
+        _available = remaining() < quantity ? remaining() : quantity;
+        return _available;
+    }
+
+    size_t write(uint8_t) { return 1; }
+    size_t write(const uint8_t *, size_t size) { return size; }
+    int available() { return _available; }
+    int read() {
+        if (_available == 0) return -1;
+        _available--;
+        return _capture[_position++];
+    }
+    int peek() { return _available ? _capture[_position] : -1; }
+
+   private:
+    const uint8_t *_capture;
+    size_t _capture_size;
+    size_t _position;
+    size_t _available;
+};
+
+extern TwoWire Wire;
+
+#endif
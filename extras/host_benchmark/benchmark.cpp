@@ -0,0 +1,319 @@
+// Host-side benchmark for the TFmini Plus frame parser.
+// Replays byte streams through the driver on a desktop and reports the cost of each receive path.
+// See README.md in this folder for build instructions.
+
+#include <TFmini_plus.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+TwoWire Wire;
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * UART stand-in that plays back a capture as if every byte had already arrived.
+ */
+class ReplayStream : public Stream {
+   public:
+    ReplayStream() : _capture(0), _position(0) {}
+
+    void replay(const std::vector<uint8_t> &capture) {
+        _capture = &capture;
+        _position = 0;
+    }
+
+    int available() { return int(_capture->size() - _position); }
+    int read() { return available() > 0 ? (*_capture)[_position++] : -1; }
+    int peek() { return available() > 0 ? (*_capture)[_position] : -1; }
+    size_t write(uint8_t) { return 1; }
+
+   private:
+    const std::vector<uint8_t> *_capture;
+    size_t _position;
+};
+
+typedef struct {
+    const char *name;
+    std::vector<uint8_t> capture;
+    bool frame_aligned;  // True if every 9-byte chunk is a whole frame; required for the I2C replay
+} scenario_t;
+
+typedef struct {
+    unsigned long frames;
+    unsigned long resyncs;
+    double nanoseconds;
+} result_t;
+
+const size_t FRAMES_PER_CAPTURE = 20000;
+const int REPEATS = 20;
+
+///////////////////////////////////////////////////////////////////////////////
+
+void append_frame(std::vector<uint8_t> &capture, uint16_t distance, uint16_t strength, uint16_t raw_temperature) {
+    uint8_t frame[TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE] = {
+        TFMINI_PLUS_RESPONSE_FRAME_HEADER, TFMINI_PLUS_RESPONSE_FRAME_HEADER, uint8_t(distance), uint8_t(distance >> 8), uint8_t(strength),
+        uint8_t(strength >> 8), uint8_t(raw_temperature), uint8_t(raw_temperature >> 8), 0};
+    for (uint8_t i = 0; i < sizeof(frame) - 1; i++) frame[sizeof(frame) - 1] += frame[i];
+    capture.insert(capture.end(), frame, frame + sizeof(frame));
+}
+
+void append_random_frame(std::vector<uint8_t> &capture) { append_frame(capture, 30 + rand() % 1170, 100 + rand() % 3000, 2208 + rand() % 80); }
+
+/**
+ * Build the synthetic captures.
+ * clean: back-to-back frames.
+ * noisy: one bit in about every thousand bytes is flipped.
+ * desynchronised: up to 8 garbage bytes are inserted before one frame in ten.
+ * truncated: one frame in ten is cut short.
+ */
+std::vector<scenario_t> build_scenarios() {
+    std::vector<scenario_t> scenarios(4);
+    scenarios[0].name = "clean";
+    scenarios[1].name = "noisy";
+    scenarios[2].name = "desynchronised";
+    scenarios[3].name = "truncated";
+
+    srand(1);
+    for (size_t i = 0; i < FRAMES_PER_CAPTURE; i++) {
+        std::vector<uint8_t> frame;
+        append_random_frame(frame);
+
+        scenarios[0].capture.insert(scenarios[0].capture.end(), frame.begin(), frame.end());
+
+        std::vector<uint8_t> noisy = frame;
+        for (size_t j = 0; j < noisy.size(); j++) {
+            if (rand() % 1000 == 0) noisy[j] ^= 1 << (rand() % 8);
+        }
+        scenarios[1].capture.insert(scenarios[1].capture.end(), noisy.begin(), noisy.end());
+
+        if (rand() % 10 == 0) {
+            for (int j = 1 + rand() % 8; j > 0; j--) scenarios[2].capture.push_back(rand());
+        }
+        scenarios[2].capture.insert(scenarios[2].capture.end(), frame.begin(), frame.end());
+
+        size_t length = (rand() % 10 == 0) ? 2 + rand() % 7 : frame.size();
+        scenarios[3].capture.insert(scenarios[3].capture.end(), frame.begin(), frame.begin() + length);
+    }
+
+    scenarios[0].frame_aligned = true;
+    scenarios[1].frame_aligned = true;
+    scenarios[2].frame_aligned = false;
+    scenarios[3].frame_aligned = false;
+    return scenarios;
+}
+
+bool load_capture(const char *path, scenario_t &scenario) {
+    FILE *file = fopen(path, "rb");
+    if (not file) return false;
+
+    uint8_t buffer[512];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) scenario.capture.insert(scenario.capture.end(), buffer, buffer + count);
+    fclose(file);
+
+    scenario.name = path;
+    scenario.frame_aligned = false;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * The original blocking receive: hunt for 0x59 0x59, then read the rest of the frame and check it.
+ * Kept as a baseline for the incremental parser.
+ */
+bool legacy_receive_data(Stream &stream, uint8_t *output) {
+    while (stream.available() >= TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE) {
+        if (stream.read() == TFMINI_PLUS_RESPONSE_FRAME_HEADER and stream.read() == TFMINI_PLUS_RESPONSE_FRAME_HEADER) {
+            output[0] = TFMINI_PLUS_RESPONSE_FRAME_HEADER;
+            output[1] = TFMINI_PLUS_RESPONSE_FRAME_HEADER;
+            stream.readBytes(&output[2], TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE - 2);
+
+            uint8_t checksum = 0;
+            for (uint8_t i = 0; i < TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE - 1; i++) checksum += output[i];
+            return checksum == output[TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE - 1];
+        }
+    }
+    return false;
+}
+
+result_t run_legacy(const scenario_t &scenario) {
+    result_t result = {0, 0, 0};
+    ReplayStream stream;
+    uint8_t frame[TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE];
+
+    for (int repeat = 0; repeat < REPEATS; repeat++) {
+        stream.replay(scenario.capture);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (stream.available() >= TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE) {
+            if (legacy_receive_data(stream, frame)) {
+                result.frames++;
+            } else {
+                result.resyncs++;
+            }
+        }
+        result.nanoseconds += elapsed_ns(start);
+    }
+    return result;
+}
+
+/**
+ * The original read_data() over UART: the receive above behind its millis() timeout, then the
+ * measurements decoded and range checked as the old read_data_response() did.
+ */
+bool legacy_read_data(Stream &stream, tfminiplus_data_t &data) {
+    uint8_t frame[TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE];
+    unsigned long start_time = millis();
+    bool result = (millis() - start_time) < TFMINI_PLUS_DATA_TIMEOUT and legacy_receive_data(stream, frame);
+
+    data.distance = frame[2] + (frame[3] << 8);
+    result &= data.distance > 0;
+    data.strength = frame[4] + (frame[5] << 8);
+    result &= data.strength > 0 and data.strength != 65535;
+    data.temperature = (frame[6] + (frame[7] << 8)) / 8.0 - 256;
+    result &= data.temperature < 100;
+    return result;
+}
+
+result_t run_legacy_read_data(const scenario_t &scenario) {
+    result_t result = {0, 0, 0};
+    ReplayStream stream;
+    tfminiplus_data_t data;
+
+    for (int repeat = 0; repeat < REPEATS; repeat++) {
+        stream.replay(scenario.capture);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (stream.available() >= TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE) {
+            if (legacy_read_data(stream, data)) {
+                result.frames++;
+            } else {
+                result.resyncs++;
+            }
+        }
+        result.nanoseconds += elapsed_ns(start);
+    }
+    return result;
+}
+
+result_t run_poll(const scenario_t &scenario) {
+    result_t result = {0, 0, 0};
+    ReplayStream stream;
+    TFminiPlus lidar;
+    tfminiplus_data_t data;
+
+    for (int repeat = 0; repeat < REPEATS; repeat++) {
+        stream.replay(scenario.capture);
+        lidar.begin(&stream);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (stream.available() > 0) {
+            if (lidar.poll(data)) result.frames++;
+        }
+        result.nanoseconds += elapsed_ns(start);
+
+        tfminiplus_stats_t stats = lidar.get_stats();
+        result.resyncs += stats.resyncs + stats.checksum_errors;
+    }
+    return result;
+}
+
+result_t run_read_frames(const scenario_t &scenario) {
+    result_t result = {0, 0, 0};
+    ReplayStream stream;
+    TFminiPlus lidar;
+    tfminiplus_data_t data[32];
+
+    for (int repeat = 0; repeat < REPEATS; repeat++) {
+        stream.replay(scenario.capture);
+        lidar.begin(&stream);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (stream.available() > 0) result.frames += lidar.read_frames(data, 32);
+        result.nanoseconds += elapsed_ns(start);
+
+        tfminiplus_stats_t stats = lidar.get_stats();
+        result.resyncs += stats.resyncs + stats.checksum_errors;
+    }
+    return result;
+}
+
+result_t run_i2c(const scenario_t &scenario) {
+    result_t result = {0, 0, 0};
+    TFminiPlus lidar;
+    tfminiplus_data_t data;
+
+    for (int repeat = 0; repeat < REPEATS; repeat++) {
+        Wire.replay(scenario.capture.data(), scenario.capture.size());
+        lidar.begin(0x10, &Wire);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (Wire.remaining() >= TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE) {
+            if (lidar.read_data(data)) result.frames++;
+        }
+        result.nanoseconds += elapsed_ns(start);
+
+        tfminiplus_stats_t stats = lidar.get_stats();
+        result.resyncs += stats.checksum_errors + stats.invalid_frames + stats.timeouts;
+    }
+    return result;
+}
+
+/**
+ * Time poll() on a stream with nothing waiting, as in most iterations of a control loop that
+ * runs faster than the framerate.
+ *
+ * @return: Nanoseconds per call.
+ */
+double run_idle_poll() {
+    const long CALLS = 1000000;
+    std::vector<uint8_t> empty;
+    ReplayStream stream;
+    TFminiPlus lidar;
+    tfminiplus_data_t data;
+
+    stream.replay(empty);
+    lidar.begin(&stream);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long i = 0; i < CALLS; i++) lidar.poll(data);
+    return elapsed_ns(start) / CALLS;
+}
+
+void report(const char *scenario, const char *path, const result_t &result) {
+    double ns_per_frame = result.frames ? result.nanoseconds / result.frames : 0;
+    double frames_per_second = ns_per_frame > 0 ? 1e9 / ns_per_frame : 0;
+    double resync_rate = result.frames ? double(result.resyncs) / result.frames : 0;
+    printf("%-16s %-12s %10.1f %14.0f %10.4f\n", scenario, path, ns_per_frame, frames_per_second, resync_rate);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv) {
+    std::vector<scenario_t> scenarios = build_scenarios();
+    for (int i = 1; i < argc; i++) {
+        scenario_t scenario;
+        if (load_capture(argv[i], scenario)) {
+            scenarios.push_back(scenario);
+        } else {
+            fprintf(stderr, "Could not read capture %s\n", argv[i]);
+        }
+    }
+
+    printf("%-16s %-12s %10s %14s %10s\n", "scenario", "path", "ns/frame", "frames/s", "resyncs");
+    for (size_t i = 0; i < scenarios.size(); i++) {
+        const scenario_t &scenario = scenarios[i];
+        report(scenario.name, "legacy", run_legacy(scenario));
+        report(scenario.name, "legacy_read", run_legacy_read_data(scenario));
+        report(scenario.name, "poll", run_poll(scenario));
+        report(scenario.name, "read_frames", run_read_frames(scenario));
+        if (scenario.frame_aligned) report(scenario.name, "i2c", run_i2c(scenario));
+    }
+
+    printf("\npoll() with nothing waiting: %.1f ns per call\n", run_idle_poll());
+
+    return 0;
+}
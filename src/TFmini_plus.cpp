@@ -1,4 +1,19 @@
 #include <TFmini_plus.h>
+#include <TFmini_plus_filter.h>
+
+// Stops ring buffer and latest-sample stores from being reordered across their index updates.
+// The ESP32 has two cores, so a hardware fence is needed there as well.
+#if defined(ESP32)
+#define TFMINI_PLUS_MEMORY_BARRIER() __sync_synchronize()
+#else
+#define TFMINI_PLUS_MEMORY_BARRIER() asm volatile("" ::: "memory")
+#endif
+
+#if TFMINI_PLUS_HAS_EXTRAS
+// log2(1 + i/16) in Q12, used to interpolate the fractional part of a logarithm
+static const uint16_t TFMINI_PLUS_LOG2_TABLE[17] PROGMEM = {0,    358,  696,  1016, 1319, 1607, 1882, 2145, 2396,
+                                                            2637, 2869, 3092, 3307, 3514, 3715, 3908, 4096};
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -10,10 +25,11 @@
  * @param size: Number of bytes to send.
  * @return: True for successful transmission.
  */
-bool TFminiPlus::send(uint8_t *input, uint8_t size) {
+bool TFminiPlus::send(const uint8_t *input, uint8_t size) {
     bool result = false;
     if (_communications_mode == TFMINI_PLUS_UART) result = send_uart(input, size);
     if (_communications_mode == TFMINI_PLUS_I2C) result = send_i2c(input, size);
+    _last_send_time = millis();
 
     return result;
 }
@@ -25,12 +41,21 @@ bool TFminiPlus::send(uint8_t *input, uint8_t size) {
  * @param size: Number of bytes to send.
  * @return: True if the correct number of bytes were sent.
  */
-bool TFminiPlus::send_uart(uint8_t *input, uint8_t size) {
-    // Burn any other bytes waiting in the receive buffer
-    dump_serial_cache();
-    dump_serial_cache();
+bool TFminiPlus::send_uart(const uint8_t *input, uint8_t size) {
+    if (_uart_policy == TFMINI_PLUS_UART_ORDERED) {
+        // Everything already waiting predates the command; the parser tags it as it is read
+        _bytes_before_command = bytes_available();
+
+        // Triggers and data requests are answered with a data frame, which never clears the flag
+        uint8_t command = input[TFMINI_PLUS_PACKET_POS_COMMAND];
+        _awaiting_response = command != TFMINI_PLUS_TRIGGER_DETECTION and command != TFMINI_PLUS_GET_DATA;
+    } else if (_uart_policy == TFMINI_PLUS_UART_DRAIN) {
+        drain_receive_buffer();
+    } else {
+        dump_serial_cache();
+    }
 
-    uint8_t bytes_sent = _stream->write(input, size) == size;
+    uint8_t bytes_sent = _stream->write(input, size);
 
     return bytes_sent == size;
 }
@@ -42,11 +67,11 @@ bool TFminiPlus::send_uart(uint8_t *input, uint8_t size) {
  * @param size: Number of bytes to send.
  * @return: True if the correct number of bytes were sent.
  */
-bool TFminiPlus::send_i2c(uint8_t *input, uint8_t size) {
-    Wire.beginTransmission(_address);
-    uint8_t bytes_sent = Wire.write(input, size);
-    if (bytes_sent != size) Wire.write(0);
-    uint8_t error = Wire.endTransmission(true);
+bool TFminiPlus::send_i2c(const uint8_t *input, uint8_t size) {
+    _bus->beginTransmission(_address);
+    uint8_t bytes_sent = _bus->write(input, size);
+    if (bytes_sent != size) _bus->write(0);
+    uint8_t error = _bus->endTransmission(true);
     return (bytes_sent == size and not error);
 }
 
@@ -65,8 +90,24 @@ bool TFminiPlus::send_i2c(uint8_t *input, uint8_t size) {
  * @return: True if the transmission was successful.
  */
 bool TFminiPlus::send_command(tfminiplus_command_t command, uint8_t *arguments, uint8_t size) {
-    bool result;
-    uint8_t packet[size];
+    bool result = false;
+    if (size < TFMINI_PLUS_MINIMUM_PACKET_SIZE or size > TFMINI_PLUS_MAXIMUM_PACKET_SIZE) return result;
+
+    uint8_t packet[TFMINI_PLUS_MAXIMUM_PACKET_SIZE];
+    tfminiplus_build_packet(packet, command, arguments, size);
+    result = send(packet, size);
+    return result;
+}
+
+/**
+ * Assemble a command packet with its header and checksum.
+ *
+ * @param packet: Container to build the packet in; must hold at least size bytes.
+ * @param command: 8-bit command to send; see TFMINI_PLUS_COMMANDS.
+ * @param arguments: Container containing the command arguments in little-endian format.
+ * @param size: Total number of bytes in the packet, including header and checksum.
+ */
+void tfminiplus_build_packet(uint8_t *packet, tfminiplus_command_t command, const uint8_t *arguments, uint8_t size) {
     packet[0] = TFMINI_PLUS_FRAME_START;
     packet[1] = size;
     packet[2] = command;
@@ -79,14 +120,13 @@ bool TFminiPlus::send_command(tfminiplus_command_t command, uint8_t *arguments,
     }
 
     // Slap on the checksum and run
-    packet[size - 1] = calculate_checksum(packet, size - 1);
-    result = send(packet, size);
-    return result;
+    packet[size - 1] = tfminiplus_calculate_checksum(packet, size - 1);
 }
 
 /**
  * Send a command packet to the lidar.
  * Only to be used with commands that do not take arguments.
+ * Fixed commands on the hot path should use the precomputed TFMINI_PLUS_PACKET_ constants with send_packet() instead.
  *
  * @param command: 8-bit command to send; see TFMINI_PLUS_COMMANDS.
  * @return: True if the transmission was successful.
@@ -113,7 +153,10 @@ bool TFminiPlus::receive(uint8_t *output, uint8_t size) {
     result = (bytes_received == size);
 
     // Data is valid if the packet length matches the received length value and if the checksum matches
-    result &= compare_checksum(output, size);
+    if (result and not tfminiplus_compare_checksum(output, size)) {
+        TFMINI_PLUS_COUNT(checksum_errors);
+        result = false;
+    }
     return result;
 }
 
@@ -125,27 +168,61 @@ bool TFminiPlus::receive(uint8_t *output, uint8_t size) {
  * @return: True if the expected number of bytes was read.
  */
 uint8_t TFminiPlus::receive_uart(uint8_t *output, uint8_t size, unsigned long timeout) {
+    if (_uart_policy == TFMINI_PLUS_UART_ORDERED) return receive_uart_ordered(output, size, timeout);
+
     bool packet_start_found = false;
     unsigned long start_time = millis();
     uint8_t bytes_read = 0;
 
     // Discard data until a valid packet header is found (0x5a)
     while ((millis() - start_time) < timeout and not packet_start_found) {
-        if (_stream->available() >= size) {
-            if (_stream->read() == TFMINI_PLUS_FRAME_START) {
-                if (_stream->read() == size) {
+        if (bytes_available() >= size) {
+            if (read_byte() == TFMINI_PLUS_FRAME_START) {
+                if (read_byte() == size) {
                     packet_start_found = true;
                     output[0] = TFMINI_PLUS_FRAME_START;
                     output[1] = size;
-                    bytes_read = _stream->readBytes(&output[2], size - 2) + 2;
+                    for (bytes_read = 2; bytes_read < size; bytes_read++) output[bytes_read] = read_byte();
                 }
             }
         }
     }
 
+    if (not packet_start_found) TFMINI_PLUS_COUNT(timeouts);
     return bytes_read;
 }
 
+/**
+ * Receive a command response from the UART without discarding data frames.
+ * Bytes go through the shared parser, so a data frame that arrives while waiting is set aside for
+ * the next read. Only one frame is held; if several arrive, the newest is kept.
+ *
+ * @param output: Container for data to read into.
+ * @param size: Number of bytes expected to be read.
+ * @param timeout: Maximum time to wait for the response in ms.
+ * @return: Number of bytes read; 0 if no response of the right size arrived.
+ */
+uint8_t TFminiPlus::receive_uart_ordered(uint8_t *output, uint8_t size, unsigned long timeout) {
+    unsigned long start_time = millis();
+
+    while ((millis() - start_time) < timeout) {
+        if (bytes_available() <= 0) continue;
+
+        tfminiplus_frame_type_t frame_type = parse_byte(read_byte());
+        if (frame_type == TFMINI_PLUS_FRAME_DATA) {
+            stash_frame();
+        } else if (frame_type == TFMINI_PLUS_FRAME_RESPONSE and _parser.get_frame_length() == size) {
+            memcpy(output, _parser.get_frame(), size);
+            return size;
+        }
+    }
+
+    // The response is not coming, so later frames are no longer read during the command
+    _awaiting_response = false;
+    TFMINI_PLUS_COUNT(timeouts);
+    return 0;
+}
+
 /**
  * Receive data from the I2C bus.
  *
@@ -154,11 +231,11 @@ uint8_t TFminiPlus::receive_uart(uint8_t *output, uint8_t size, unsigned long ti
  * @return: True if the expected number of bytes was read.
  */
 uint8_t TFminiPlus::receive_i2c(uint8_t *output, uint8_t size) {
-    Wire.requestFrom(_address, size, true);
+    _bus->requestFrom(_address, size, true);
 
     uint8_t bytes_read = 0;
-    for (size_t i = 0; (i < size) and Wire.available(); i++) {
-        uint8_t c = Wire.read();
+    for (size_t i = 0; (i < size) and _bus->available(); i++) {
+        uint8_t c = _bus->read();
         output[i] = c;
         bytes_read++;
     }
@@ -174,356 +251,1853 @@ uint8_t TFminiPlus::receive_i2c(uint8_t *output, uint8_t size) {
  *
  * @param output: Container to read data into.
  * @param size: Number of bytes that are expected to be received
- * @return: True if the expected number of bytes were received.
+ * @param timeout: Maximum time to wait for a packet in ms.
+ * @return: True if a complete packet with a valid checksum was received.
  */
 bool TFminiPlus::uart_receive_data(uint8_t *output, uint8_t size, unsigned long timeout) {
-    bool packet_start_found = false;
+    bool packet_found = false;
     unsigned long start_time = millis();
 
-    // Discard data until a valid packet header is found (0x5959)
-    while ((millis() - start_time) < timeout and not packet_start_found) {
-        if (_stream->available() >= 9) {
-            if (_stream->read() == TFMINI_PLUS_RESPONSE_FRAME_HEADER and _stream->read() == TFMINI_PLUS_RESPONSE_FRAME_HEADER) {
-                output[0] = TFMINI_PLUS_RESPONSE_FRAME_HEADER;
-                output[1] = TFMINI_PLUS_RESPONSE_FRAME_HEADER;
-                packet_start_found = true;
-            }
+    if (_frame_stashed) {
+        memcpy(output, _stashed_frame, size);
+        _frame_stashed = false;
+        _frame_time = _stashed_frame_time;
+        _frame_flags = _stashed_frame_flags;
+        return true;
+    }
+
+    // Feed the parser until it reports a full frame; partial frames carry over to the next call
+    while ((millis() - start_time) < timeout and not packet_found) {
+        if (bytes_available() > 0 and parse_byte(read_byte()) == TFMINI_PLUS_FRAME_DATA) {
+            memcpy(output, _parser.get_frame(), size);
+            packet_found = true;
         }
     }
 
-    // Read in the rest of the packet
-    uint8_t bytes_read = _stream->readBytes(&output[2], size - 2) + 2;
-    return bytes_read == size;
+    if (not packet_found) {
+#if TFMINI_PLUS_HAS_EXTRAS
+        _health_errors++;
+#endif
+        TFMINI_PLUS_COUNT(timeouts);
+    }
+    return packet_found;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-
 /**
- * Check if the calculate checksum of a data packet matches the sent checksum byte.
+ * Get the newest data frame from UART.
+ * Every byte waiting in the stream is parsed in one pass and only the last valid frame is kept.
+ * Older frames are discarded and counted; see get_frames_skipped().
  *
- * @param data: Container of received packet.
- * @param size: Number of bytes contained in the packet, including headers and checksum.
- * @return: True if the checksums match.
+ * @param frame: View to point at the newest frame. Valid until the next read from the driver.
+ * @return: True if at least one valid frame was waiting in the stream.
  */
-bool TFminiPlus::compare_checksum(uint8_t *data, uint8_t size) {
-    uint8_t checksum = calculate_checksum(data, size - 1);
-    bool checksums_match = checksum == data[size - 1];
+bool TFminiPlus::uart_receive_latest_frame(TFminiPlusFrame &frame) {
+    _frames_skipped = 0;
+    bool frame_found = take_stashed_frame(frame);
+    if (frame_found) memcpy(_latest_frame, frame.get_raw(), sizeof(_latest_frame));
+    uint32_t latest_time = _frame_time;
+    uint8_t latest_flags = _frame_flags;
+
+    // Only the raw bytes are kept while draining; nothing is decoded until the newest frame is known
+    while (_block_remaining > 0) {
+        if (parse_block_byte() != TFMINI_PLUS_FRAME_DATA) continue;
+        if (not TFminiPlusFrame(_parser.get_frame()).is_valid()) {
+            TFMINI_PLUS_COUNT(invalid_frames);
+        } else {
+            if (frame_found) _frames_skipped++;
+            memcpy(_latest_frame, _parser.get_frame(), sizeof(_latest_frame));
+            latest_time = _frame_time;
+            latest_flags = _frame_flags;
+            frame_found = true;
+        }
+    }
 
-    return checksums_match;
+    _frame_time = latest_time;
+    _frame_flags = latest_flags;
+    if (frame_found) frame = TFminiPlusFrame(_latest_frame);
+    return frame_found;
 }
 
 /**
- * Calculate the checksum for a container.
+ * Get the number of received bytes waiting to be parsed.
+ * Bytes come from the ring buffer if one is attached; otherwise straight from the stream.
  *
- * @param data: Container with data to calculate checksum.
- * @param size: Number of bytes in container.
- * @return: Checksum of data in the container.
+ * @return: Number of bytes available to read.
  */
-uint8_t TFminiPlus::calculate_checksum(uint8_t *data, uint8_t size) {
-    uint8_t checksum = 0;
-
-    for (size_t i = 0; i < size; i++) {
-        checksum += data[i];
-    }
-    return checksum;
+int TFminiPlus::bytes_available() {
+    if (not _ring_buffer) return _stream->available();
+    return uint8_t(_ring_head - _ring_tail);
 }
 
 /**
- * Wait for the lidar to process a command.
- * This wait is only required when using the I2C bus.
- * This wait is also not required when requesting a data packet on either communication mode.
+ * Read the next received byte.
+ * This is the consumer side of the ring buffer and must only be called from the main loop.
+ *
+ * @return: Next byte, or -1 if nothing is waiting.
  */
-void TFminiPlus::do_i2c_wait() {
-    if (_communications_mode == TFMINI_PLUS_I2C) delay(150);
-}
+int TFminiPlus::read_byte() {
+    if (not _ring_buffer) return _stream->read();
 
-///////////////////////////////////////////////////////////////////////////////
+    uint8_t tail = _ring_tail;
+    if (tail == _ring_head) return -1;
+
+    uint8_t c = _ring_buffer[tail & _ring_mask];
+    TFMINI_PLUS_MEMORY_BARRIER();
+    _ring_tail = tail + 1;
+    return c;
+}
 
 /**
- * Start communication with the lidar in I2C mode.
- * @param address: I2C address of the lidar. Defaults to 0x10.
+ * Feed a received byte to the parser.
+ * Command responses are handed to the command queue as soon as they are complete.
+ *
+ * @param c: Next byte from the lidar.
+ * @return: Type of frame completed by the byte.
  */
-void TFminiPlus::begin(uint8_t address) {
-    _communications_mode = TFMINI_PLUS_I2C;
-    _address = address & 0x7F;
+tfminiplus_frame_type_t TFminiPlus::parse_byte(uint8_t c) {
+    tfminiplus_frame_type_t frame_type = _parser.parse(c);
+    if (_parser.get_received_count() == 1) _header_time = get_header_arrival_time();
+    // Clean bytes are by far the most common, so they skip the call
+    if (_parser.get_status() != TFMINI_PLUS_PARSE_OK) record_parse_status();
+
+    if (frame_type == TFMINI_PLUS_FRAME_DATA) {
+#if TFMINI_PLUS_HAS_EXTRAS
+        // Counted here rather than where frames are read, so the supervisor sees every read path
+        _health_frames++;
+#endif
+        _frame_time = _header_time;
+        _frame_flags = _parser.is_text_frame() ? TFMINI_PLUS_DATA_PIXHAWK : 0;
+        if (_bytes_before_command > 0) {
+            _frame_flags |= TFMINI_PLUS_DATA_BEFORE_COMMAND;
+        } else if (_awaiting_response) {
+            _frame_flags |= TFMINI_PLUS_DATA_DURING_COMMAND;
+        }
+    } else if (frame_type == TFMINI_PLUS_FRAME_RESPONSE) {
+        _awaiting_response = false;
+#if TFMINI_PLUS_HAS_CONFIG
+        handle_response(_parser.get_frame(), _parser.get_frame_length());
+#endif
+    }
+
+    if (_bytes_before_command > 0) _bytes_before_command--;
+    return frame_type;
 }
 
 /**
- * Start communication with the lidar in UART mode.
- * @param stream: Pointer to a stream object for communication (eg. HardwareSerial or SoftwareSerial)
+ * Feed the next byte of the block counted by start_block() to the parser, along with the rest
+ * of the frame body it is part of. Body bytes cannot start, finish, or break a frame, so they
+ * are handed straight to the parser once per frame instead of each going through parse_byte().
+ *
+ * @return: Type of frame completed by the byte.
  */
-void TFminiPlus::begin(Stream *stream) {
-    _communications_mode = TFMINI_PLUS_UART;
-    _stream = stream;
-    _stream->flush();
+tfminiplus_frame_type_t TFminiPlus::parse_block_byte() {
+    _block_remaining--;
+    tfminiplus_frame_type_t frame_type = parse_byte(read_byte());
+
+    uint8_t body = _parser.get_body_remaining();
+    if (body > _block_remaining) body = _block_remaining;
+    _block_remaining -= body;
+    _bytes_before_command = _bytes_before_command > body ? _bytes_before_command - body : 0;
+    for (uint8_t i = 0; i < body; i++) _parser.parse(read_byte());
+    return frame_type;
 }
 
 /**
- * Set the I2C address of the lidar.
- * This will change the slave address of the lidar so the device is mapped to a separate logical location.
- * Changes will take effect immediately upon confirmation that the address has been received correctly.
- *
- * @param address: I2C slave address to change the lidar to. (0x01 - 0x7F)
- * @param return: True if the address change was successful.
+ * Get the time at which the byte just read arrived.
+ * Without a ring buffer, the frame readers and parse_buffer() work the arrival back from the time the
+ * block was counted and the bytes still left in it. With a ring buffer, it is worked back from the
+ * time of the newest pushed byte and the bytes queued behind it.
  *
+ * @return: Arrival time in micros().
  */
-bool TFminiPlus::set_i2c_address(uint8_t address) {
-    bool result = false;
-
-    send_command(TFMINI_PLUS_SET_I2C_ADDRESS, &address, TFMINI_PLUS_PACK_LENGTH_SET_I2C_ADDRESS);
-    do_i2c_wait();
-
-    // Only commit the changes if the correct address is echoed back
-    uint8_t response[TFMINI_PLUS_PACK_LENGTH_SET_I2C_ADDRESS];
-    if (receive(response, sizeof(response)) and response[3] == address) {
-        result = save_settings();
-        if (result) {
-            _address = address;
+uint32_t TFminiPlus::get_header_arrival_time() {
+    if (_scanning_block) {
+        // Blocks from start_block() are timed at their first header, so reads that find no frame skip micros()
+        if (not _block_timed) {
+            _block_time = micros();
+            _block_timed = true;
         }
+        return _block_time - uint32_t(_block_remaining) * _byte_time;
     }
+    if (not _ring_buffer) return micros();
 
-    return result;
+    // The push time is written from an interrupt and may tear on 8-bit cores
+    uint32_t last_push_time;
+    do {
+        last_push_time = _last_push_time;
+    } while (last_push_time != _last_push_time);
+
+    return last_push_time - uint32_t(bytes_available()) * _byte_time;
 }
 
 /**
- * Get the firmware version of the lidar.
- *
- * @return: Version information of lidar firmware. [major, minor, revision]
+ * Take a count of the received bytes for the frame readers to consume.
+ * The stream is asked once per batch rather than once per byte. Without a ring buffer, the bytes
+ * are also timed back from when they were counted, as parse_buffer() does; clear _scanning_block afterwards.
+ * That time is only read once a frame header turns up, so it is late by the time spent parsing the
+ * bytes before the header.
  */
-tfminiplus_version_t TFminiPlus::get_version() {
-    tfminiplus_version_t version;
-
-    send_command(TFMINI_PLUS_GET_VERSION);
-    do_i2c_wait();
-
-    uint8_t response[TFMINI_PLUS_PACK_LENGTH_VERSION_RESPONSE];
-    if (receive(response, sizeof(response)) and response[TFMINI_PLUS_PACKET_POS_COMMAND] == TFMINI_PLUS_GET_VERSION) {
-        version.revision = response[3];
-        version.minor = response[4];
-        version.major = response[5];
-    }
-
-    return version;
+void TFminiPlus::start_block() {
+    int available = bytes_available();
+    _block_remaining = available > 0 ? available : 0;
+    _block_timed = false;
+    _scanning_block = not _ring_buffer;
 }
 
 /**
- * Set the framerate of the lidar.
- * The datasheet recommends that the refresh rate stay below 100Hz when using I2C mode.
- * Changes will not take effect until settings have been saved.
+ * Keep the framerate the lidar is sending at, for estimating sample times.
+ * The half-period offset is worked out here so frames are not each paying for a division.
  *
- * @param framerate: Framerate to set the lidar to in Hz.
- * @return: True if the framerate change was successfully received.
+ * @param framerate: Framerate of the lidar in Hz, or 0 if frames are only sent on request.
  */
-bool TFminiPlus::set_framerate(tfminiplus_framerate_t framerate) {
-    bool result = false;
-    uint8_t argument[2];
-    argument[0] = framerate & 0xFF;
-    argument[1] = framerate >> 8;
-    send_command(TFMINI_PLUS_SET_FRAME_RATE, argument, TFMINI_PLUS_PACK_LENGTH_SET_FRAME_RATE);
-    do_i2c_wait();
+void TFminiPlus::remember_framerate(uint16_t framerate) {
+    _framerate = framerate;
+    _sample_offset = tfminiplus_get_sample_offset(framerate);
+}
 
-    uint8_t response[TFMINI_PLUS_PACK_LENGTH_SET_FRAME_RATE];
-    if (receive(response, sizeof(response))) {
-        if (argument[0] == response[3] and argument[1] == response[4]) result = true;
+/**
+ * Count parser errors for the last byte fed to the parser.
+ */
+void TFminiPlus::record_parse_status() {
+    tfminiplus_parse_status_t status = _parser.get_status();
+    if (status == TFMINI_PLUS_PARSE_OK) return;
+
+#if TFMINI_PLUS_HAS_EXTRAS
+    // Health counts feed the recovery supervisor, so they are kept even without stats
+    if (status == TFMINI_PLUS_PARSE_DISCARDED) {
+        _health_discarded++;
+    } else {
+        _health_errors++;
     }
-
-    return result;
+#endif
+
+#ifndef TFMINI_PLUS_DISABLE_STATS
+    switch (status) {
+        case TFMINI_PLUS_PARSE_DISCARDED:
+            _stats.bytes_discarded++;
+            break;
+        case TFMINI_PLUS_PARSE_RESYNC:
+            _stats.resyncs++;
+            break;
+        case TFMINI_PLUS_PARSE_CHECKSUM_ERROR:
+            _stats.checksum_errors++;
+            break;
+        default:
+            break;
+    }
+#endif
 }
 
 /**
- * Set the baudrate of the lidar.
- * Changes will not take effect until settings have been saved.
+ * Get the start time of a read call for record_call_time().
  *
- * @param baudrate: Baudrate to set UART communications to.
- * @return: True if the baudrate change was successfully received.
+ * @return: micros(), or 0 if call timing is off.
  */
-bool TFminiPlus::set_baudrate(tfminiplus_baudrate_t baudrate) {
-    bool result = false;
-    uint8_t argument[4];
-    argument[0] = baudrate & 0xFF;
-    argument[1] = baudrate >> 8;
-    argument[2] = baudrate >> 16;
-    argument[3] = baudrate >> 24;
-
-    send_command(TFMINI_PLUS_SET_BAUD_RATE, argument, TFMINI_PLUS_PACK_LENGTH_SET_BAUD_RATE);
-    do_i2c_wait();
-
-    // Verify the echoed baudrate
-    uint8_t response[TFMINI_PLUS_PACK_LENGTH_SET_BAUD_RATE];
-    if (receive(response, sizeof(response))) {
-        if (argument[0] == response[3] and argument[1] == response[4] and argument[2] == response[5] and argument[3] == response[6]) result = true;
-    }
-    return result;
+uint32_t TFminiPlus::get_call_start_time() {
+#ifndef TFMINI_PLUS_DISABLE_STATS
+    if (_call_timing) return micros();
+#endif
+    return 0;
 }
 
 /**
- * Set the output format of the lidar.
- * The output format changes the output units or enables a pixhawk-compatible stream.
- * Changes must be saved to take effect.
+ * Add the time taken by a read call to the call time statistics.
  *
- * @param format: Format option to change the lidar output to.
- * @result: True if the format change was received succesfully.
+ * @param start_time: Time from get_call_start_time().
  */
-bool TFminiPlus::set_output_format(tfminiplus_output_format_t format) {
-    bool result = false;
-
-    send_command(TFMINI_PLUS_SET_OUTPUT_FORMAT, (uint8_t *)&format, TFMINI_PLUS_PACK_LENGTH_SET_OUTPUT_FORMAT);
-    do_i2c_wait();
-
-    uint8_t response[TFMINI_PLUS_PACK_LENGTH_SET_OUTPUT_FORMAT];
-    if (receive(response, sizeof(response))) {
-        if (format == response[3]) result = true;
-    }
-
-    return result;
+void TFminiPlus::record_call_time(uint32_t start_time) {
+#ifndef TFMINI_PLUS_DISABLE_STATS
+    if (not _call_timing) return;
+
+    uint32_t call_time = micros() - start_time;
+    if (_stats.calls == 0 or call_time < _stats.min_call_time) _stats.min_call_time = call_time;
+    if (call_time > _stats.max_call_time) _stats.max_call_time = call_time;
+    _stats.total_call_time += call_time;
+    _stats.calls++;
+#else
+    (void)start_time;
+#endif
 }
 
 /**
- * Take a manual reading of the lidar.
- * This method is useful when the framerate has been changed to 0 Hz
- * and readings are taken on an on-demand basis.
+ * Get the driver health counters.
+ * All counters are zero if the library was built with TFMINI_PLUS_DISABLE_STATS.
  *
- * @param data: Data container to read the lidar output into.
- * @return: True if a data output frame was received successfully.
+ * @return: Copy of the counters, with the average call time filled in.
  */
-bool TFminiPlus::read_manual_reading(tfminiplus_data_t &data) {
-    trigger_manual_reading();
-    return read_data(data);
+tfminiplus_stats_t TFminiPlus::get_stats() {
+#ifndef TFMINI_PLUS_DISABLE_STATS
+    tfminiplus_stats_t stats = _stats;
+    stats.average_call_time = stats.calls ? stats.total_call_time / stats.calls : 0;
+    return stats;
+#else
+    tfminiplus_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    return stats;
+#endif
 }
 
 /**
- * Request the lidar to do a manual read.
- * Useful for on-demand measurements.
+ * Zero all driver health counters.
  */
-void TFminiPlus::trigger_manual_reading() { send_command(TFMINI_PLUS_TRIGGER_DETECTION); }
+void TFminiPlus::reset_stats() {
+#ifndef TFMINI_PLUS_DISABLE_STATS
+    memset(&_stats, 0, sizeof(_stats));
+#endif
+}
 
 /**
- * Take a manual reading of the lidar.
- * This method is useful when the framerate has been changed to 0 Hz
- * and readings are taken on an on-demand basis.
+ * Time each call to poll() and read_data() for the call time statistics.
+ * Off by default, since it costs poll() a second micros() read for every frame.
  *
- * @return: Data container that includes distance, strength, and temperature measurements.
+ * @param enabled: True to collect the call times.
  */
-tfminiplus_data_t TFminiPlus::get_manual_reading() {
-    tfminiplus_data_t data;
-    read_manual_reading(data);
-    return data;
+void TFminiPlus::set_call_timing(bool enabled) {
+#ifndef TFMINI_PLUS_DISABLE_STATS
+    _call_timing = enabled;
+#else
+    (void)enabled;
+#endif
 }
 
 /**
- * Take a manual reading of the lidar.
- * This method is useful when the framerate has been changed to 0 Hz
- * and readings are taken on an on-demand basis.
- *
- * @return: Distance in cm/mm (depending on configuration).
+ * Set aside the frame the parser has just completed, along with its arrival time.
  */
-uint16_t TFminiPlus::get_manual_distance() { return get_manual_reading().distance; }
+void TFminiPlus::stash_frame() {
+    memcpy(_stashed_frame, _parser.get_frame(), sizeof(_stashed_frame));
+    _stashed_frame_time = _frame_time;
+    _stashed_frame_flags = _frame_flags;
+    _frame_stashed = true;
+}
 
 /**
- * Read a data frame from the lidar.
- * If using the UART interface, frames are continually sent and do not need to be specifically requested.
+ * Collect a data frame that was set aside while the command queue was reading the stream.
  *
- * @param data: Data container to read output frame into.
- * @param in_mm_format: True to request the data frame in mm units (I2C only).
- * @return: True if the data frame was received successfully.
+ * @param frame: View to point at the frame.
+ * @return: True if a valid frame was waiting.
  */
-bool TFminiPlus::read_data(tfminiplus_data_t &data, bool in_mm_format) {
-    uint8_t command = 1 + 5 * in_mm_format;
-    if (_communications_mode == TFMINI_PLUS_I2C) send_command(TFMINI_PLUS_GET_DATA, &command, TFMINI_PLUS_PACK_LENGTH_GET_DATA);
-    do_i2c_wait();
-    return read_data_response(data);
+bool TFminiPlus::take_stashed_frame(TFminiPlusFrame &frame) {
+    if (not _frame_stashed) return false;
+    _frame_stashed = false;
+    _frame_time = _stashed_frame_time;
+    _frame_flags = _stashed_frame_flags;
+    frame = TFminiPlusFrame(_stashed_frame);
+    return frame.is_valid();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+TFminiPlusParser::TFminiPlusParser() : _status(TFMINI_PLUS_PARSE_OK), _text_format(false), _text_frame(false) { reset(); }
+
+/**
+ * Discard any partially received frame and go back to hunting for a header.
+ */
+void TFminiPlusParser::reset() {
+    _index = 0;
+    _checksum = 0;
+    _text_length = 0;
+    _text_decimals = -1;
+    _text_value = 0;
 }
 
 /**
- * Read a data frame from the lidar.
- * If using the UART interface, frames are continually sent and do not need to be specifically requested.
+ * Tell the parser which output format the lidar is sending.
+ * Binary frames and command responses are always recognised; Pixhawk text is only decoded when selected.
  *
- * @param in_mm_format: True to request the data frame in mm units (I2C only).
- * @return: Data container that includes distance, strength, and temperature measurements.
+ * @param format: Output format of the lidar.
  */
-tfminiplus_data_t TFminiPlus::get_data(bool in_mm_format) {
-    tfminiplus_data_t data;
-    read_data(data, in_mm_format);
-    return data;
+void TFminiPlusParser::set_output_format(tfminiplus_output_format_t format) {
+    _text_format = (format == TFMINI_PLUS_OUTPUT_PIXHAWK);
+    reset();
 }
 
 /**
- * Read a data frame from the lidar.
- * If using the UART interface, frames are continually sent and do not need to be specifically requested.
+ * Check if the last completed data frame was decoded from Pixhawk text.
  *
- * @param in_mm_format: True to request the data frame in mm units (I2C only).
- * @return: Distance in cm/mm (depending on configuration).
+ * @return: True if the frame's strength and temperature are placeholders.
  */
-uint16_t TFminiPlus::get_distance(bool in_mm_format) { return get_data(in_mm_format).distance; }
+bool TFminiPlusParser::is_text_frame() { return _text_frame; }
 
 /**
- * Read in a response frame from the lidar.
- * Data frames are read in normally with I2C mode after a request.
- * In UART mode, frames are sent in when available.
+ * Handle a byte that starts, sizes, or finishes a frame (see parse()).
+ * Data frames use the following structure:
+ * [0-1] 0x59 0x59 - Frame header
+ * [2-3] Distance
+ * [4-5] Strength
+ * [6-7] Raw temperature
+ * [8] Checksum
  *
- * @param data: Data frame to read the lidar output into.
- * @return: True if the response was received correctly.
+ * Command responses use the same structure as command packets (see send_command).
+ *
+ * @param c: Next byte from the lidar.
+ * @return: Type of frame completed by the byte, or TFMINI_PLUS_FRAME_NONE if the frame is incomplete or corrupt.
  */
-bool TFminiPlus::read_data_response(tfminiplus_data_t &data) {
-    bool result = false;
+tfminiplus_frame_type_t TFminiPlusParser::parse_boundary(uint8_t c) {
+    tfminiplus_frame_type_t frame_type = TFMINI_PLUS_FRAME_NONE;
+    bool accepted = true;
+    _status = TFMINI_PLUS_PARSE_OK;
+
+#if TFMINI_PLUS_HAS_EXTRAS
+    // Text characters never start a binary frame, so they can only belong to a Pixhawk line
+    if (_text_format and _index == 0) {
+        if ((c >= '0' and c <= '9') or c == '.' or c == '\r' or c == '\n') return parse_text(c);
+        if (_text_length > 0) {
+            reset();
+            _status = TFMINI_PLUS_PARSE_RESYNC;
+        }
+    }
+#endif
+
+    if (_index == 0) {
+        accepted = (c == TFMINI_PLUS_RESPONSE_FRAME_HEADER or c == TFMINI_PLUS_FRAME_START);
+        _length = TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE;
+
+    } else if (_index == 1) {
+        if (_frame[0] == TFMINI_PLUS_RESPONSE_FRAME_HEADER) {
+            accepted = (c == TFMINI_PLUS_RESPONSE_FRAME_HEADER);
+        } else {
+            // The second byte of a command response is its total length
+            accepted = (c >= TFMINI_PLUS_MINIMUM_PACKET_SIZE and c <= TFMINI_PLUS_MAXIMUM_PACKET_SIZE);
+            _length = c;
+        }
+    }
+
+    if (not accepted) {
+        // A rejected byte may still be the start of the next frame
+        _status = (_index > 0) ? TFMINI_PLUS_PARSE_RESYNC : TFMINI_PLUS_PARSE_DISCARDED;
+        reset();
+        if (c == TFMINI_PLUS_RESPONSE_FRAME_HEADER or c == TFMINI_PLUS_FRAME_START) {
+            _frame[_index++] = c;
+            _checksum = c;
+            _length = TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE;
+        }
+
+    } else if (_index == _length - 1) {
+        _frame[_index] = c;
+        if (c == _checksum) {
+            frame_type = (_frame[0] == TFMINI_PLUS_RESPONSE_FRAME_HEADER) ? TFMINI_PLUS_FRAME_DATA : TFMINI_PLUS_FRAME_RESPONSE;
+            _text_frame = false;
+        } else {
+            _status = TFMINI_PLUS_PARSE_CHECKSUM_ERROR;
+        }
+        reset();
 
-    // Grab the data
-    uint8_t response[TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE];
-    if (_communications_mode == TFMINI_PLUS_UART) {
-        result = uart_receive_data(response, sizeof(response));
     } else {
-        result = receive(response, sizeof(response));
+        // Header and length bytes; the rest of the frame is stored by parse()
+        _frame[_index++] = c;
+        _checksum += c;
     }
 
-    // Put the data into the proper format
+    return frame_type;
+}
+
+#if TFMINI_PLUS_HAS_EXTRAS
+/**
+ * Feed a byte of a Pixhawk text line into the parser.
+ * Lines are distances in metres with up to two decimal places, eg. "1.25\r\n".
+ * The distance is converted to cm with integer arithmetic only.
+ *
+ * @param c: Next character from the lidar.
+ * @return: TFMINI_PLUS_FRAME_DATA when a line is completed; otherwise TFMINI_PLUS_FRAME_NONE.
+ */
+tfminiplus_frame_type_t TFminiPlusParser::parse_text(uint8_t c) {
+    bool accepted = true;
+
+    if (c >= '0' and c <= '9') {
+        // Anything past centimetre resolution is dropped
+        if (_text_decimals < 2) {
+            _text_value = _text_value * 10 + (c - '0');
+            if (_text_decimals >= 0) _text_decimals++;
+        }
+        accepted = (_text_value <= 0xFFFF);
+
+    } else if (c == '.') {
+        accepted = (_text_length > 0 and _text_decimals < 0);
+        _text_decimals = 0;
+
+    } else if (c == '\n') {
+        if (_text_length == 0) {
+            accepted = false;
+        } else {
+            uint32_t distance = _text_value;
+            for (int8_t i = (_text_decimals < 0) ? 0 : _text_decimals; i < 2; i++) distance *= 10;
+            reset();
+
+            if (distance > 0xFFFF) {
+                _status = TFMINI_PLUS_PARSE_DISCARDED;
+                return TFMINI_PLUS_FRAME_NONE;
+            }
+            build_text_frame(distance);
+            return TFMINI_PLUS_FRAME_DATA;
+        }
 
-    data.distance = response[2] + (response[3] << 8);
-    result &= data.distance > 0;
+    } else if (_text_length == 0) {
+        // A carriage return that does not end a number
+        accepted = false;
+    }
 
-    data.strength = response[4] + (response[5] << 8);
-    result &= data.strength > 0 and data.strength != 65535;
+    if (accepted) accepted = (_text_length < TFMINI_PLUS_PIXHAWK_MAXIMUM_LINE);
 
-    data.temperature = (response[6] + (response[7] << 8)) / 8.0 - 256;
-    result &= data.temperature < 100;
+    if (not accepted) {
+        _status = (_text_length > 0) ? TFMINI_PLUS_PARSE_RESYNC : TFMINI_PLUS_PARSE_DISCARDED;
+        reset();
+        return TFMINI_PLUS_FRAME_NONE;
+    }
 
-    return result;
+    _text_length++;
+    return TFMINI_PLUS_FRAME_NONE;
 }
 
 /**
- * Set the IO mode of the lidar.
- * Changes will not occur until settings have been saved.
- * Modes:
- *  0 - Standard: Output is transmitted over UART or I2C.
- *  1 - IO LN/HF - Output pin is high if the measured distance is above the defined distance; otherwise low.
- *  2 - IO HN/LF - Output pin is low if the measured distance is above the defined distance; otherwise high.
+ * Store a distance decoded from text as a binary data frame.
  *
- * @param mode: Output mode of the lidar [0-2].
- * @param critical_distance: Threshold distance in cm for the near/far zones when using IO modes.
- * @param hysteresis: Hysteresis in cm used when switching between near/far zones when using IO modes.
- * @return: True if the mode change was received successfully.
+ * @param distance: Distance in cm.
  */
-bool TFminiPlus::set_io_mode(tfminiplus_mode_t mode, uint16_t critical_distance, uint16_t hysteresis) {
-    uint8_t arguments[5];
-    arguments[0] = mode;
-    arguments[1] = uint8_t(critical_distance);
-    arguments[2] = critical_distance >> 8;
-    arguments[3] = uint8_t(hysteresis);
-    arguments[4] = hysteresis >> 8;
+void TFminiPlusParser::build_text_frame(uint16_t distance) {
+    _frame[0] = TFMINI_PLUS_RESPONSE_FRAME_HEADER;
+    _frame[1] = TFMINI_PLUS_RESPONSE_FRAME_HEADER;
+    _frame[2] = uint8_t(distance);
+    _frame[3] = distance >> 8;
+    _frame[4] = uint8_t(TFMINI_PLUS_PIXHAWK_STRENGTH);
+    _frame[5] = TFMINI_PLUS_PIXHAWK_STRENGTH >> 8;
+    _frame[6] = uint8_t(TFMINI_PLUS_PIXHAWK_RAW_TEMPERATURE);
+    _frame[7] = TFMINI_PLUS_PIXHAWK_RAW_TEMPERATURE >> 8;
 
-    return send_command(TFMINI_PLUS_SET_IO_MODE, arguments, TFMINI_PLUS_PACK_LENGTH_SET_IO_MODE);
+    uint8_t checksum = 0;
+    for (uint8_t i = 0; i < TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE - 1; i++) checksum += _frame[i];
+    _frame[TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE - 1] = checksum;
+
+    _length = TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE;
+    _text_frame = true;
 }
+#endif
 
 /**
- * Set the communication mode for the lidar.
- * Changes are applied immediately.
- * The library will switch to use the mode specified if the change was successfully applied.
+ * Get the last frame completed by the parser.
+ * The contents are only valid until the next byte is parsed.
  *
- * @param mode: Communication mode. [UART, I2C]
+ * @return: Pointer to the raw frame.
+ */
+const uint8_t *TFminiPlusParser::get_frame() { return _frame; }
+
+/**
+ * Get the length of the last frame completed by the parser.
+ *
+ * @return: Number of bytes in the frame, including headers and checksum.
+ */
+uint8_t TFminiPlusParser::get_frame_length() { return _length; }
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Check if the calculate checksum of a data packet matches the sent checksum byte.
+ *
+ * @param data: Container of received packet.
+ * @param size: Number of bytes contained in the packet, including headers and checksum.
+ * @return: True if the checksums match.
+ */
+bool tfminiplus_compare_checksum(const uint8_t *data, uint8_t size) {
+    uint8_t checksum = tfminiplus_calculate_checksum(data, size - 1);
+    bool checksums_match = checksum == data[size - 1];
+
+    return checksums_match;
+}
+
+/**
+ * Calculate the checksum for a container.
+ *
+ * @param data: Container with data to calculate checksum.
+ * @param size: Number of bytes in container.
+ * @return: Checksum of data in the container.
+ */
+uint8_t tfminiplus_calculate_checksum(const uint8_t *data, uint8_t size) {
+    uint8_t checksum = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        checksum += data[i];
+    }
+    return checksum;
+}
+
+/**
+ * Receive the response to a command that was just sent.
+ * In I2C mode the lidar is polled with an increasing backoff until a matching response appears,
+ * instead of waiting out the worst-case processing time. The first poll is scheduled from the
+ * latency previously observed for the same command, counted from when the command was sent.
+ *
+ * @param output: Container for received data, headers, and checksum.
+ * @param size: Number of bytes expected to receive.
+ * @param command: Command that the response belongs to.
+ * @return: True if a response with a valid header and checksum was received.
+ */
+bool TFminiPlus::receive_response(uint8_t *output, uint8_t size, tfminiplus_command_t command) {
+    if (_communications_mode != TFMINI_PLUS_I2C) return receive(output, size);
+
+    unsigned long timeout = tfminiplus_get_response_timeout(command);
+    unsigned long interval = TFMINI_PLUS_I2C_POLL_INTERVAL_MIN;
+    unsigned long first_poll = _latency.get_first_poll_delay(command);
+    bool first_attempt = true;
+
+    unsigned long elapsed = millis() - _last_send_time;
+    if (elapsed < first_poll) delay(first_poll - elapsed);
+
+    while (true) {
+        if (receive(output, size) and tfminiplus_is_response_for(output, size, command)) {
+            _latency.record_response(command, millis() - _last_send_time, first_attempt);
+            return true;
+        }
+        if ((millis() - _last_send_time) >= timeout) {
+            TFMINI_PLUS_COUNT(timeouts);
+            return false;
+        }
+        first_attempt = false;
+
+        delay(interval);
+        if (interval < TFMINI_PLUS_I2C_POLL_INTERVAL_MAX) interval <<= 1;
+    }
+}
+
+/**
+ * Check that a received packet has the shape of the response to a command.
+ * The checksum is assumed to have been verified already.
+ *
+ * @param response: Received packet.
+ * @param size: Number of bytes in the packet.
+ * @param command: Command that the response should belong to.
+ * @return: True if the headers and command code match.
+ */
+bool tfminiplus_is_response_for(const uint8_t *response, uint8_t size, tfminiplus_command_t command) {
+    if (command == TFMINI_PLUS_GET_DATA or command == TFMINI_PLUS_TRIGGER_DETECTION) {
+        return response[0] == TFMINI_PLUS_RESPONSE_FRAME_HEADER and response[1] == TFMINI_PLUS_RESPONSE_FRAME_HEADER;
+    }
+    return response[TFMINI_PLUS_PACKET_POS_START] == TFMINI_PLUS_FRAME_START and response[TFMINI_PLUS_PACKET_POS_LENGTH] == size and
+           response[TFMINI_PLUS_PACKET_POS_COMMAND] == command;
+}
+
+/**
+ * Get the longest time the lidar is allowed to take to respond to a command.
+ * Commands that write to the lidar's flash are given longer.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @return: Response deadline in ms.
+ */
+unsigned long tfminiplus_get_response_timeout(tfminiplus_command_t command) {
+    if (command == TFMINI_PLUS_SAVE_SETTINGS or command == TFMINI_PLUS_SYSTEM_RESET or command == TFMINI_PLUS_RESTORE_FACTORY_SETTINGS) {
+        return TFMINI_PLUS_SLOW_RESPONSE_TIMEOUT;
+    }
+    return TFMINI_PLUS_RESPONSE_TIMEOUT;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Forget every learned latency.
+ */
+void TFminiPlusLatency::reset() { memset(_typical, 0, sizeof(_typical)); }
+
+/**
+ * Get the position of a command in the latency table.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @return: Index into the table.
+ */
+uint8_t TFminiPlusLatency::get_slot(tfminiplus_command_t command) {
+    uint8_t slot = command;
+
+    // Commands 0-7 map directly; the sparse codes are packed in after them
+    if (command == TFMINI_PLUS_SET_COMMUNICATION_INTERFACE) slot = 8;
+    if (command == TFMINI_PLUS_SET_I2C_ADDRESS) slot = 9;
+    if (command == TFMINI_PLUS_SET_IO_MODE) slot = 10;
+    if (command == TFMINI_PLUS_RESTORE_FACTORY_SETTINGS) slot = 11;
+    if (command == TFMINI_PLUS_SAVE_SETTINGS) slot = 12;
+
+    return slot < TFMINI_PLUS_LATENCY_SLOTS ? slot : 0;
+}
+
+/**
+ * Get the typical response latency of a command.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @return: Typical latency in ms, or 0 if none has been seen yet.
+ */
+uint8_t TFminiPlusLatency::get_typical(tfminiplus_command_t command) const { return _typical[get_slot(command)]; }
+
+/**
+ * Get how long to wait after sending a command before the first poll for its response.
+ * Polling is started a little before the typical latency so a fast response is not missed.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @return: Delay before the first poll in ms.
+ */
+unsigned long TFminiPlusLatency::get_first_poll_delay(tfminiplus_command_t command) const { return (get_typical(command) * 3) / 4; }
+
+/**
+ * Fold a measured response time into the typical latency of a command.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @param latency: Time between sending the command and receiving its response in ms.
+ */
+void TFminiPlusLatency::record(tfminiplus_command_t command, unsigned long latency) {
+    uint8_t &typical = _typical[get_slot(command)];
+    if (latency > 255) latency = 255;
+    typical = (3 * typical + latency) / 4;
+}
+
+/**
+ * Fold the response time of a polled response into the typical latency of its command.
+ * A response that was already waiting at the first poll only gives an upper bound on the latency,
+ * so it is only kept if it does not raise the typical latency.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @param latency: Time between sending the command and receiving its response in ms.
+ * @param first_attempt: True if the response was found by the first poll.
+ */
+void TFminiPlusLatency::record_response(tfminiplus_command_t command, unsigned long latency, bool first_attempt) {
+    if (not first_attempt or latency <= get_typical(command)) record(command, latency);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Start communication with the lidar in I2C mode.
+ * @param address: I2C address of the lidar. Defaults to 0x10.
+ * @param bus: I2C bus the lidar is connected to (eg. &Wire1). Defaults to &Wire.
+ */
+void TFminiPlus::begin(uint8_t address, TwoWire *bus) {
+    _communications_mode = TFMINI_PLUS_I2C;
+    _address = address & 0x7F;
+    _bus = bus;
+    initialise();
+}
+
+/**
+ * Start communication with the lidar in UART mode.
+ * @param stream: Pointer to a stream object for communication (eg. HardwareSerial or SoftwareSerial)
+ */
+void TFminiPlus::begin(Stream *stream) {
+    _communications_mode = TFMINI_PLUS_UART;
+    _stream = stream;
+    _bus = 0;
+    _stream->flush();
+    initialise();
+}
+
+/**
+ * Put the parser, buffers, and command queue into their starting state.
+ */
+void TFminiPlus::initialise() {
+    _parser.set_output_format(TFMINI_PLUS_OUTPUT_CM);
+    _read_mode = TFMINI_PLUS_READ_FIRST;
+    _frames_skipped = 0;
+    _frame_stashed = false;
+    _ring_buffer = 0;
+
+#if TFMINI_PLUS_HAS_CONFIG
+    _queue_head = 0;
+    _queue_count = 0;
+    _command_in_flight = false;
+    _configuration_pending = 0;
+    _configuration_ok = true;
+#endif
+    _latency.reset();
+
+    _pipelined = false;
+    _data_requested = false;
+    _data_poll_delay = 0;
+    _data_poll_interval = TFMINI_PLUS_I2C_POLL_INTERVAL_MIN;
+    _last_send_time = 0;
+
+    _filter = 0;
+
+    remember_framerate(TFMINI_PLUS_DEFAULT_FRAMERATE);
+    set_host_baudrate(TFMINI_PLUS_DEFAULT_BAUDRATE);
+    _header_time = 0;
+    _frame_time = 0;
+    _stashed_frame_time = 0;
+    _last_push_time = 0;
+    _block_time = 0;
+    _block_timed = false;
+    _block_remaining = 0;
+    _scanning_block = false;
+    _latest_sequence = 0;
+    forget_settings();
+#if TFMINI_PLUS_HAS_EXTRAS
+    _threshold_callback = 0;
+    _change_callback = 0;
+    _zone = TFMINI_PLUS_ZONE_UNKNOWN;
+    _change_primed = false;
+    _recovery_enabled = false;
+    _recovery_level = TFMINI_PLUS_RECOVERY_NONE;
+    reset_health();
+#endif
+#if defined(ESP32)
+    _task = 0;
+#endif
+    reset_stats();
+    set_call_timing(false);
+
+    _uart_policy = TFMINI_PLUS_UART_DRAIN;
+    _bytes_before_command = 0;
+    _awaiting_response = false;
+    _frame_flags = 0;
+    _stashed_frame_flags = 0;
+}
+
+/**
+ * Receive UART data through a ring buffer instead of reading the stream directly (UART only).
+ * Bytes are pushed in with push_byte() or ingest() from a serial RX interrupt or callback,
+ * so frames are not lost when the core's serial buffer would otherwise overflow.
+ * The buffer is single-producer, single-consumer: only the RX callback may push, and only the main loop may read.
+ * Attach it after begin(), which detaches any buffer attached before it.
+ *
+ * @param buffer: Storage for the ring buffer, or 0 to go back to reading the stream.
+ * @param size: Size of the storage in bytes. Only the largest power of two that fits is used.
+ */
+void TFminiPlus::attach_ring_buffer(uint8_t *buffer, uint8_t size) {
+    uint8_t capacity = 1;
+    while (capacity <= size / 2) capacity <<= 1;
+
+    _ring_buffer = 0;
+    _ring_head = 0;
+    _ring_tail = 0;
+    _ring_mask = capacity - 1;
+    if (size > 0) _ring_buffer = buffer;
+}
+
+/**
+ * Add a received byte to the ring buffer.
+ * Safe to call from an interrupt while the main loop is parsing.
+ *
+ * @param c: Byte received from the lidar.
+ * @return: True if the byte was stored; false if the buffer is full or not attached.
+ */
+bool TFminiPlus::push_byte(uint8_t c) {
+    if (not _ring_buffer) return false;
+
+    uint8_t head = _ring_head;
+    if (uint8_t(head - _ring_tail) > _ring_mask) {
+        TFMINI_PLUS_COUNT(ring_overflows);
+        return false;
+    }
+
+    _ring_buffer[head & _ring_mask] = c;
+    _last_push_time = micros();
+    TFMINI_PLUS_MEMORY_BARRIER();
+    _ring_head = head + 1;
+    return true;
+}
+
+/**
+ * Move all bytes waiting in the stream into the ring buffer.
+ * Intended to be called from the serial RX callback (eg. serialEvent() or HardwareSerial::onReceive()).
+ * Bytes that do not fit are left in the stream for the next call.
+ */
+void TFminiPlus::ingest() {
+    while (_stream->available() > 0 and push_byte(_stream->peek())) {
+        _stream->read();
+    }
+}
+
+/**
+ * Parse a block of received bytes in place (UART only).
+ * Intended for DMA or driver buffers that are filled without the CPU, eg. the half and full
+ * transfer callbacks of a circular DMA, or a block read from the ESP-IDF UART driver.
+ * The whole block is consumed. A frame split across two blocks is completed by the next call.
+ * Frames are timestamped as if the last byte of the block arrived when this is called.
+ *
+ * @param buffer: Received bytes. Only read during the call.
+ * @param size: Number of bytes in the buffer.
+ * @param callback: Function called for each valid data frame, or null to keep only the newest frame
+ *      for the next poll() or read_data().
+ * @param context: Pointer passed through to the callback.
+ * @return: Number of valid data frames found.
+ */
+size_t TFminiPlus::parse_buffer(const uint8_t *buffer, size_t size, tfminiplus_frame_callback_t callback, void *context) {
+    size_t count = 0;
+    tfminiplus_data_t data;
+
+    _block_time = micros();
+    _block_timed = true;
+    _scanning_block = true;
+    for (size_t i = 0; i < size; i++) {
+        _block_remaining = size - i - 1;
+        if (parse_byte(buffer[i]) != TFMINI_PLUS_FRAME_DATA) continue;
+
+        if (callback) {
+            if (parse_data_frame(_parser.get_frame(), data)) {
+                callback(data, context);
+                count++;
+            }
+        } else if (TFminiPlusFrame(_parser.get_frame()).is_valid()) {
+            stash_frame();
+            count++;
+        } else {
+            TFMINI_PLUS_COUNT(invalid_frames);
+        }
+    }
+    _scanning_block = false;
+
+    return count;
+}
+
+#if TFMINI_PLUS_HAS_EXTRAS
+/**
+ * Set the I2C address of the lidar.
+ * This will change the slave address of the lidar so the device is mapped to a separate logical location.
+ * Changes will take effect immediately upon confirmation that the address has been received correctly.
+ *
+ * @param address: I2C slave address to change the lidar to. (0x01 - 0x7F)
+ * @param return: True if the address change was successful.
+ *
+ */
+bool TFminiPlus::set_i2c_address(uint8_t address) {
+    bool result = false;
+
+    send_packet(tfminiplus_make_packet_u8(TFMINI_PLUS_SET_I2C_ADDRESS, address));
+
+    // Only commit the changes if the correct address is echoed back
+    uint8_t response[TFMINI_PLUS_PACK_LENGTH_SET_I2C_ADDRESS];
+    if (receive_response(response, sizeof(response), TFMINI_PLUS_SET_I2C_ADDRESS) and response[3] == address) {
+        result = save_settings();
+        if (result) {
+            _address = address;
+        }
+    }
+
+    return result;
+}
+#endif
+
+#if TFMINI_PLUS_HAS_CONFIG
+/**
+ * Get the firmware version of the lidar.
+ * The version is only asked for once; later calls return the cached copy.
+ *
+ * @return: Version information of lidar firmware. [major, minor, revision]
+ */
+tfminiplus_version_t TFminiPlus::get_version() {
+    tfminiplus_version_t version = _version;
+    if (not _version_known) read_version(version);
+    return version;
+}
+
+/**
+ * Get the firmware version of the lidar.
+ * Always asks the lidar, so it is also useful as a check that the lidar is talking at the expected baudrate.
+ *
+ * @param version: Container for the version information. [major, minor, revision]
+ * @return: True if the lidar replied with its version.
+ */
+bool TFminiPlus::read_version(tfminiplus_version_t &version) {
+    bool result = false;
+
+    send_packet(TFMINI_PLUS_PACKET_GET_VERSION);
+
+    uint8_t response[TFMINI_PLUS_PACK_LENGTH_VERSION_RESPONSE];
+    if (receive_response(response, sizeof(response), TFMINI_PLUS_GET_VERSION) and response[TFMINI_PLUS_PACKET_POS_COMMAND] == TFMINI_PLUS_GET_VERSION) {
+        version.revision = response[3];
+        version.minor = response[4];
+        version.major = response[5];
+        result = true;
+
+        _version = version;
+        _version_known = true;
+    }
+
+    return result;
+}
+
+/**
+ * Set the framerate of the lidar.
+ * The datasheet recommends that the refresh rate stay below 100Hz when using I2C mode.
+ * Changes will not take effect until settings have been saved.
+ *
+ * @param framerate: Framerate to set the lidar to in Hz.
+ * @return: True if the framerate change was successfully received.
+ */
+bool TFminiPlus::set_framerate(tfminiplus_framerate_t framerate) {
+    // Nothing to send if the lidar already has this setting
+    if ((_settings_known & TFMINI_PLUS_SETTING_FRAMERATE) and _settings.framerate == framerate) return true;
+
+    bool result = false;
+    tfminiplus_packet_t<TFMINI_PLUS_PACK_LENGTH_SET_FRAME_RATE> packet = tfminiplus_make_packet_u16(TFMINI_PLUS_SET_FRAME_RATE, framerate);
+    send_packet(packet);
+
+    uint8_t response[TFMINI_PLUS_PACK_LENGTH_SET_FRAME_RATE];
+    if (receive_response(response, sizeof(response), TFMINI_PLUS_SET_FRAME_RATE)) {
+        if (packet.data[3] == response[3] and packet.data[4] == response[4]) result = true;
+    }
+
+    // If the echo was lost the lidar may or may not have the setting, so it must be sent again next time
+    if (result) {
+        remember_setting(packet.data);
+    } else {
+        _settings_known &= ~TFMINI_PLUS_SETTING_FRAMERATE;
+    }
+    return result;
+}
+
+/**
+ * Set the baudrate of the lidar.
+ * Changes will not take effect until settings have been saved.
+ *
+ * @param baudrate: Baudrate to set UART communications to.
+ * @return: True if the baudrate change was successfully received.
+ */
+bool TFminiPlus::set_baudrate(tfminiplus_baudrate_t baudrate) {
+    if ((_settings_known & TFMINI_PLUS_SETTING_BAUDRATE) and _settings.baudrate == baudrate) return true;
+
+    bool result = false;
+    tfminiplus_packet_t<TFMINI_PLUS_PACK_LENGTH_SET_BAUD_RATE> packet = tfminiplus_make_packet_u32(TFMINI_PLUS_SET_BAUD_RATE, baudrate);
+    send_packet(packet);
+
+    // Verify the echoed baudrate
+    uint8_t response[TFMINI_PLUS_PACK_LENGTH_SET_BAUD_RATE];
+    if (receive_response(response, sizeof(response), TFMINI_PLUS_SET_BAUD_RATE)) {
+        if (memcmp(&packet.data[3], &response[3], 4) == 0) result = true;
+    }
+
+    if (result) {
+        remember_setting(packet.data);
+    } else {
+        _settings_known &= ~TFMINI_PLUS_SETTING_BAUDRATE;
+    }
+    return result;
+}
+#endif
+
+/**
+ * Tell the driver which baudrate the host UART is running at.
+ * Only used to estimate frame arrival times in ring buffer mode; negotiate_baudrate() keeps it up to date.
+ *
+ * @param baudrate: Baudrate of the host UART.
+ */
+void TFminiPlus::set_host_baudrate(uint32_t baudrate) {
+    if (baudrate == 0) return;
+
+    _host_baudrate = baudrate;
+    _byte_time = (1000000UL * TFMINI_PLUS_UART_BITS_PER_BYTE) / baudrate;
+}
+
+#if TFMINI_PLUS_HAS_EXTRAS
+/**
+ * Move the lidar and the host to a new UART baudrate, falling back to the current one on failure.
+ * The lidar is told to change rate and save, the host is switched with the callback, and the link is
+ * verified by reading the firmware version. If the lidar cannot be heard at the new rate, the host
+ * goes back to the current rate; if the lidar did switch, it is told to return to the current rate.
+ *
+ * @param baudrate: Baudrate to move to.
+ * @param current_baudrate: Baudrate the host and lidar are using now.
+ * @param host_baudrate_callback: Function that re-begins the host UART at a given baudrate.
+ * @return: True if both ends are communicating at the new baudrate.
+ */
+bool TFminiPlus::negotiate_baudrate(tfminiplus_baudrate_t baudrate, tfminiplus_baudrate_t current_baudrate,
+                                    tfminiplus_baudrate_callback_t host_baudrate_callback) {
+    if (_communications_mode != TFMINI_PLUS_UART or not host_baudrate_callback) return false;
+
+    // The caller knows the current baudrate better than the cache, which may hold the rate being moved to
+    _settings_known &= ~TFMINI_PLUS_SETTING_BAUDRATE;
+    if (not set_baudrate(baudrate)) return false;
+
+    // The save response may already come back at the new rate, so its result is not relied on
+    save_settings();
+    if (switch_host_baudrate(baudrate, host_baudrate_callback)) {
+        _recovery_baudrate = baudrate;
+        return true;
+    }
+
+    // Still talking at the old rate means the lidar never switched, whatever set_baudrate() cached
+    if (switch_host_baudrate(current_baudrate, host_baudrate_callback)) {
+        _settings.baudrate = current_baudrate;
+        _settings_known |= TFMINI_PLUS_SETTING_BAUDRATE;
+        return false;
+    }
+
+    // The lidar switched but the link is unusable at the new rate; ask it to come back
+    host_baudrate_callback(baudrate);
+    set_baudrate(current_baudrate);
+    save_settings();
+    if (not switch_host_baudrate(current_baudrate, host_baudrate_callback)) _settings_known &= ~TFMINI_PLUS_SETTING_BAUDRATE;
+    return false;
+}
+
+/**
+ * Switch the host UART to a baudrate and check that the lidar can be heard.
+ *
+ * @param baudrate: Baudrate to switch the host to.
+ * @param host_baudrate_callback: Function that re-begins the host UART at a given baudrate.
+ * @return: True if the lidar replied at the new baudrate.
+ */
+bool TFminiPlus::switch_host_baudrate(uint32_t baudrate, tfminiplus_baudrate_callback_t host_baudrate_callback) {
+    host_baudrate_callback(baudrate);
+    set_host_baudrate(baudrate);
+    delay(TFMINI_PLUS_BAUDRATE_SETTLE_TIME);
+    _parser.reset();
+
+    tfminiplus_version_t version;
+    for (uint8_t attempt = 0; attempt < TFMINI_PLUS_NEGOTIATION_ATTEMPTS; attempt++) {
+        if (read_version(version)) return true;
+    }
+    return false;
+}
+#endif
+
+#if TFMINI_PLUS_HAS_CONFIG
+/**
+ * Set the output format of the lidar.
+ * The output format changes the output units or enables a pixhawk-compatible stream.
+ * Changes must be saved to take effect.
+ *
+ * @param format: Format option to change the lidar output to.
+ * @result: True if the format change was received succesfully.
+ */
+bool TFminiPlus::set_output_format(tfminiplus_output_format_t format) {
+    if ((_settings_known & TFMINI_PLUS_SETTING_OUTPUT_FORMAT) and _settings.output_format == format) return true;
+
+    bool result = false;
+    tfminiplus_packet_t<TFMINI_PLUS_PACK_LENGTH_SET_OUTPUT_FORMAT> packet = tfminiplus_make_packet_u8(TFMINI_PLUS_SET_OUTPUT_FORMAT, format);
+    send_packet(packet);
+
+    uint8_t response[TFMINI_PLUS_PACK_LENGTH_SET_OUTPUT_FORMAT];
+    if (receive_response(response, sizeof(response), TFMINI_PLUS_SET_OUTPUT_FORMAT)) {
+        if (format == response[3]) result = true;
+    }
+
+    if (result) {
+        remember_setting(packet.data);
+    } else {
+        _settings_known &= ~TFMINI_PLUS_SETTING_OUTPUT_FORMAT;
+    }
+    return result;
+}
+#endif
+
+/**
+ * Tell the driver which output format the lidar is already using, without sending a command.
+ * Needed to read Pixhawk text from a lidar that was configured and saved beforehand.
+ *
+ * @param format: Output format the lidar has been set to.
+ */
+void TFminiPlus::expect_output_format(tfminiplus_output_format_t format) { _parser.set_output_format(format); }
+
+/**
+ * Take a manual reading of the lidar.
+ * This method is useful when the framerate has been changed to 0 Hz
+ * and readings are taken on an on-demand basis.
+ *
+ * @param data: Data container to read the lidar output into.
+ * @return: True if a data output frame was received successfully.
+ */
+bool TFminiPlus::read_manual_reading(tfminiplus_data_t &data) {
+    trigger_manual_reading();
+    return read_data(data);
+}
+
+/**
+ * Request the lidar to do a manual read.
+ * Useful for on-demand measurements.
+ */
+void TFminiPlus::trigger_manual_reading() { send_packet(TFMINI_PLUS_PACKET_TRIGGER_DETECTION); }
+
+/**
+ * Take a manual reading of the lidar.
+ * This method is useful when the framerate has been changed to 0 Hz
+ * and readings are taken on an on-demand basis.
+ *
+ * @return: Data container that includes distance, strength, and temperature measurements.
+ */
+tfminiplus_data_t TFminiPlus::get_manual_reading() {
+    tfminiplus_data_t data;
+    read_manual_reading(data);
+    return data;
+}
+
+/**
+ * Take a manual reading of the lidar.
+ * This method is useful when the framerate has been changed to 0 Hz
+ * and readings are taken on an on-demand basis.
+ *
+ * @return: Distance in cm/mm (depending on configuration).
+ */
+uint16_t TFminiPlus::get_manual_distance() { return get_manual_reading().distance; }
+
+/**
+ * Choose which frame is returned when several are waiting in the UART buffer.
+ * The first frame is the oldest; at high framerates it may be several frame periods old.
+ * Reading the latest frame drains the buffer and discards everything older.
+ *
+ * @param mode: TFMINI_PLUS_READ_FIRST or TFMINI_PLUS_READ_LATEST.
+ */
+void TFminiPlus::set_read_mode(tfminiplus_read_mode_t mode) { _read_mode = mode; }
+
+/**
+ * Get the number of valid frames that were discarded by the last latest-frame read.
+ *
+ * @return: Number of older frames skipped in favour of the newest one.
+ */
+uint16_t TFminiPlus::get_frames_skipped() { return _frames_skipped; }
+
+/**
+ * Check for a data frame from the lidar without blocking (UART only).
+ * Only the bytes already waiting in the stream are consumed; an incomplete frame is kept by the
+ * parser and finished on a later call.
+ *
+ * @param data: Data container to read output frame into.
+ * @return: True if a complete, valid data frame was received.
+ */
+bool TFminiPlus::poll(tfminiplus_data_t &data) {
+    uint32_t start_time = get_call_start_time();
+    TFminiPlusFrame frame;
+    bool result = _communications_mode == TFMINI_PLUS_UART and uart_receive_frame(frame) and parse_data_frame(frame.get_raw(), data);
+    record_call_time(start_time);
+    return result;
+}
+
+/**
+ * Check for a data frame from the lidar without blocking or copying it (UART only).
+ * The frame view points into the driver's own buffer, so decoding is left to the caller
+ * and the float temperature is only calculated if it is asked for.
+ * Since the frame is never decoded, it skips the filter, the distance events, and get_latest();
+ * use poll() for those. It is still counted in the stats and by the recovery supervisor.
+ *
+ * @param frame: View to point at the received frame. Valid until the next read from the driver.
+ * @return: True if a complete, valid data frame was received.
+ */
+bool TFminiPlus::poll_frame(TFminiPlusFrame &frame) {
+    if (_communications_mode != TFMINI_PLUS_UART) return false;
+
+    bool result = uart_receive_frame(frame);
+    if (result) TFMINI_PLUS_COUNT(frames_ok);
+    return result;
+}
+
+/**
+ * Get the next data frame from UART in the selected read mode, without decoding it.
+ *
+ * @param frame: View to point at the frame. Valid until the next read from the driver.
+ * @return: True if a complete, valid frame was found.
+ */
+bool TFminiPlus::uart_receive_frame(TFminiPlusFrame &frame) {
+    start_block();
+    bool result = _read_mode == TFMINI_PLUS_READ_LATEST ? uart_receive_latest_frame(frame) : uart_receive_next_frame(frame);
+    _scanning_block = false;
+    return result;
+}
+
+/**
+ * Decode every complete frame waiting in the UART buffer in one pass.
+ * Frames are returned oldest first. Any frames beyond max_frames are left in the buffer.
+ *
+ * @param output: Container for at least max_frames data frames.
+ * @param max_frames: Maximum number of frames to read.
+ * @return: Number of valid frames read. Always 0 in I2C mode.
+ */
+size_t TFminiPlus::read_frames(tfminiplus_data_t *output, size_t max_frames) {
+    size_t count = 0;
+    if (_communications_mode != TFMINI_PLUS_UART) return count;
+
+    TFminiPlusFrame frame;
+    start_block();
+    while (count < max_frames and uart_receive_next_frame(frame)) {
+        // Frames rejected by the filter are written over by the next one
+        if (parse_data_frame(frame.get_raw(), output[count])) count++;
+    }
+    _scanning_block = false;
+
+    return count;
+}
+
+/**
+ * Decode every complete frame waiting in the UART buffer into separate distance and strength arrays.
+ * Laying the values out as plain arrays lets filters run over them without striding past other fields.
+ * Frames go through the filter, the distance events, and get_latest() as with the struct form.
+ *
+ * @param distances: Container for at least max_frames distances.
+ * @param strengths: Container for at least max_frames strengths, or null if not needed.
+ * @param max_frames: Maximum number of frames to read.
+ * @return: Number of valid frames read. Always 0 in I2C mode.
+ */
+size_t TFminiPlus::read_frames(uint16_t *distances, uint16_t *strengths, size_t max_frames) {
+    size_t count = 0;
+    if (_communications_mode != TFMINI_PLUS_UART) return count;
+
+    TFminiPlusFrame frame;
+    tfminiplus_data_t data;
+    start_block();
+    while (count < max_frames and uart_receive_next_frame(frame)) {
+        if (not parse_data_frame(frame.get_raw(), data)) continue;
+
+        distances[count] = data.distance;
+        if (strengths) strengths[count] = data.strength;
+        count++;
+    }
+    _scanning_block = false;
+
+    return count;
+}
+
+/**
+ * Get the next valid data frame from the bytes already waiting in the UART buffer.
+ *
+ * @param frame: View to point at the frame. Valid until the next read from the driver.
+ * @return: True if a complete, valid frame was found.
+ */
+bool TFminiPlus::uart_receive_next_frame(TFminiPlusFrame &frame) {
+    bool frame_ready = take_stashed_frame(frame);
+
+    while (not frame_ready and _block_remaining > 0) {
+        if (parse_block_byte() == TFMINI_PLUS_FRAME_DATA) {
+            frame = TFminiPlusFrame(_parser.get_frame());
+            frame_ready = frame.is_valid();
+            if (not frame_ready) TFMINI_PLUS_COUNT(invalid_frames);
+        }
+    }
+
+    return frame_ready;
+}
+
+/**
+ * Read a data frame from the lidar.
+ * If using the UART interface, frames are continually sent and do not need to be specifically requested.
+ *
+ * @param data: Data container to read output frame into.
+ * @param in_mm_format: True to request the data frame in mm units (I2C only).
+ * @return: True if the data frame was received successfully.
+ */
+bool TFminiPlus::read_data(tfminiplus_data_t &data, bool in_mm_format) {
+    uint32_t start_time = get_call_start_time();
+    bool result;
+    if (_communications_mode == TFMINI_PLUS_I2C) {
+        // A pipelined request may already be in progress; only send one if it is missing or in the wrong units
+        if (not _pipelined or not _data_requested or _requested_mm_format != in_mm_format) request_data(in_mm_format);
+    }
+
+    result = read_data_response(data);
+    _data_requested = false;
+
+    // Let the lidar measure the next frame while the caller works on this one
+    if (_pipelined and _communications_mode == TFMINI_PLUS_I2C) request_data(in_mm_format);
+    record_call_time(start_time);
+    return result;
+}
+
+/**
+ * Request a data frame from the lidar without waiting for it (I2C only).
+ * The frame can be collected later with collect_data() or read_data().
+ *
+ * @param in_mm_format: True to request the data frame in mm units.
+ * @return: True if the request was sent successfully.
+ */
+bool TFminiPlus::request_data(bool in_mm_format) {
+    if (_communications_mode != TFMINI_PLUS_I2C) return false;
+
+    _data_requested = in_mm_format ? send_packet(TFMINI_PLUS_PACKET_GET_DATA_MM) : send_packet(TFMINI_PLUS_PACKET_GET_DATA_CM);
+    _requested_mm_format = in_mm_format;
+    _data_poll_delay = _latency.get_first_poll_delay(TFMINI_PLUS_GET_DATA);
+    _data_poll_interval = TFMINI_PLUS_I2C_POLL_INTERVAL_MIN;
+    return _data_requested;
+}
+
+/**
+ * Collect a data frame without blocking.
+ * In I2C mode, this makes at most one read attempt for a frame requested with request_data().
+ * Attempts follow the same schedule as the blocking reads: the first waits for the typical latency
+ * of a data request, and each miss doubles the wait before the next. Calls in between return
+ * straight away without touching the bus.
+ * In UART mode, this is the same as poll().
+ *
+ * @param data: Data container to read output frame into.
+ * @return: True if a valid data frame was collected.
+ */
+bool TFminiPlus::collect_data(tfminiplus_data_t &data) {
+    if (_communications_mode == TFMINI_PLUS_UART) return poll(data);
+    if (not _data_requested) return false;
+
+    unsigned long elapsed = millis() - _last_send_time;
+    if (elapsed < _data_poll_delay) return false;
+
+    uint8_t response[TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE];
+    if (not receive(response, sizeof(response)) or not tfminiplus_is_response_for(response, sizeof(response), TFMINI_PLUS_GET_DATA)) {
+        _data_poll_delay += _data_poll_interval;
+        if (_data_poll_interval < TFMINI_PLUS_I2C_POLL_INTERVAL_MAX) _data_poll_interval <<= 1;
+        return false;
+    }
+
+    // The interval has only grown if an attempt missed; a frame found at the first attempt may have
+    // been waiting, so it only gives an upper bound on the latency
+    bool first_attempt = (_data_poll_interval == TFMINI_PLUS_I2C_POLL_INTERVAL_MIN);
+    _latency.record_response(TFMINI_PLUS_GET_DATA, elapsed, first_attempt);
+
+    _data_requested = false;
+    _frame_time = micros();
+    return parse_data_frame(response, data);
+}
+
+/**
+ * Keep a data request in flight between reads (I2C only).
+ * When enabled, read_data() sends the next request as soon as a frame has been read, so the
+ * following call only has to collect the result.
+ *
+ * @param enabled: True to pipeline data requests.
+ */
+void TFminiPlus::set_pipelined(bool enabled) { _pipelined = enabled; }
+
+#if TFMINI_PLUS_HAS_EXTRAS
+/**
+ * Call back when the distance crosses a threshold, in the same way as the lidar's IO mode.
+ * The near event fires when the distance drops below the critical distance, and the far event
+ * when it rises above the critical distance plus the hysteresis. The first frame reports its zone.
+ * Evaluated on every valid frame read, after any filter, except frames read as views with poll_frame().
+ *
+ * @param critical_distance: Threshold distance between the near and far zones.
+ * @param hysteresis: Extra distance needed before going back to the far zone.
+ * @param callback: Function to call on a crossing, or null to disable.
+ * @param context: Pointer passed through to the callback.
+ */
+void TFminiPlus::set_threshold_event(uint16_t critical_distance, uint16_t hysteresis, tfminiplus_event_callback_t callback, void *context) {
+    _critical_distance = critical_distance;
+    _hysteresis = hysteresis;
+    _threshold_callback = callback;
+    _threshold_context = context;
+    _zone = TFMINI_PLUS_ZONE_UNKNOWN;
+}
+
+/**
+ * Call back when the distance moves further than a deadband from the last reported distance.
+ * The first frame is always reported. Evaluated on every valid frame read, after any filter,
+ * except frames read as views with poll_frame().
+ *
+ * @param deadband: Largest change that is not reported.
+ * @param callback: Function to call on a change, or null to disable.
+ * @param context: Pointer passed through to the callback.
+ */
+void TFminiPlus::set_change_event(uint16_t deadband, tfminiplus_event_callback_t callback, void *context) {
+    _deadband = deadband;
+    _change_callback = callback;
+    _change_context = context;
+    _change_primed = false;
+}
+
+/**
+ * Check a new frame against the threshold and change events.
+ *
+ * @param data: Valid frame that was just read.
+ */
+void TFminiPlus::evaluate_events(const tfminiplus_data_t &data) {
+    if (_threshold_callback) {
+        uint8_t zone = _zone;
+        if (data.distance < _critical_distance) {
+            zone = TFMINI_PLUS_ZONE_NEAR;
+        } else if (_zone == TFMINI_PLUS_ZONE_UNKNOWN or uint32_t(data.distance) > uint32_t(_critical_distance) + _hysteresis) {
+            zone = TFMINI_PLUS_ZONE_FAR;
+        }
+
+        if (zone != _zone) {
+            _zone = zone;
+            _threshold_callback(zone == TFMINI_PLUS_ZONE_NEAR ? TFMINI_PLUS_EVENT_NEAR : TFMINI_PLUS_EVENT_FAR, data, _threshold_context);
+        }
+    }
+
+    if (_change_callback) {
+        uint16_t change = (data.distance > _reported_distance) ? data.distance - _reported_distance : _reported_distance - data.distance;
+        if (not _change_primed or change > _deadband) {
+            _change_primed = true;
+            _reported_distance = data.distance;
+            _change_callback(TFMINI_PLUS_EVENT_CHANGE, data, _change_context);
+        }
+    }
+}
+
+/**
+ * Watch the health of the UART stream and recover automatically when it goes bad (UART only).
+ * Once enabled, call supervise() regularly alongside the normal reads.
+ * Assumes the lidar should be sending frames; disable recovery while its output is turned off.
+ *
+ * @param enabled: True to enable the recovery supervisor.
+ * @param error_percent: Share of checksum errors, resyncs, and timeouts (in %) above which the link is unhealthy.
+ * @param host_baudrate_callback: Function that re-begins the host UART at a given baudrate. Without it,
+ *      the baudrate step is skipped. The current host baudrate is the one recovered to, until
+ *      negotiate_baudrate() moves to another.
+ */
+void TFminiPlus::set_recovery(bool enabled, uint8_t error_percent, tfminiplus_baudrate_callback_t host_baudrate_callback) {
+    _recovery_enabled = enabled;
+    _recovery_error_percent = error_percent;
+    _recovery_host_baudrate_callback = host_baudrate_callback;
+    _recovery_baudrate = _host_baudrate;
+    _recovery_level = TFMINI_PLUS_RECOVERY_NONE;
+    _recovery_wait = TFMINI_PLUS_RECOVERY_WINDOW;
+    reset_health();
+}
+
+/**
+ * Check the stream health and take the next recovery step if it is bad.
+ * Health is judged over a window of at least TFMINI_PLUS_RECOVERY_WINDOW ms, stretched to three
+ * frame periods at slow framerates. Each bad window escalates one step: drain the buffers, restart
+ * the lidar's output, reset the lidar, then search for its baudrate. The wait after each step
+ * doubles, so a dead link does not starve the loop.
+ * Returns immediately between windows.
+ *
+ * @return: True if the link is healthy or recovery is disabled.
+ */
+bool TFminiPlus::supervise() {
+    if (not _recovery_enabled or _communications_mode != TFMINI_PLUS_UART) return true;
+
+    // Slow framerates keep the window open until it could have seen a few frames
+    unsigned long elapsed = millis() - _recovery_window_start;
+    if (elapsed < _recovery_wait) return _recovery_level == TFMINI_PLUS_RECOVERY_NONE;
+    if (_framerate > 0 and elapsed < 3000UL / _framerate) return _recovery_level == TFMINI_PLUS_RECOVERY_NONE;
+
+    if (is_link_healthy()) {
+        _recovery_level = TFMINI_PLUS_RECOVERY_NONE;
+        _recovery_wait = TFMINI_PLUS_RECOVERY_WINDOW;
+        reset_health();
+        return true;
+    }
+
+    tfminiplus_recovery_level_t last_level = _recovery_host_baudrate_callback ? TFMINI_PLUS_RECOVERY_BAUDRATE : TFMINI_PLUS_RECOVERY_RESET;
+    if (_recovery_level < last_level) _recovery_level = tfminiplus_recovery_level_t(_recovery_level + 1);
+    run_recovery_step(_recovery_level);
+
+    uint8_t backoff = _recovery_level;
+    if (backoff > TFMINI_PLUS_RECOVERY_MAX_BACKOFF) backoff = TFMINI_PLUS_RECOVERY_MAX_BACKOFF;
+    _recovery_wait = TFMINI_PLUS_RECOVERY_WINDOW << backoff;
+
+    // Bytes parsed during the step say nothing about the link afterwards
+    reset_health();
+    return false;
+}
+
+/**
+ * Get the last recovery step taken by the supervisor.
+ *
+ * @return: TFMINI_PLUS_RECOVERY_NONE if the link was healthy at the last check.
+ */
+tfminiplus_recovery_level_t TFminiPlus::get_recovery_level() { return _recovery_level; }
+
+/**
+ * Judge the stream health over the current window.
+ * Every data frame that passes its checksum counts as good, whichever call read it and whether or
+ * not its measurement is in range. Discarded bytes count as one error per frame length. A silent
+ * stream is unhealthy unless the lidar has been set to 0Hz.
+ *
+ * @return: True if the error share is within the limit.
+ */
+bool TFminiPlus::is_link_healthy() {
+    uint32_t errors = _health_errors + _health_discarded / TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE;
+    uint32_t total = _health_frames + errors;
+    if (total == 0) return _framerate == 0;
+    if (total < TFMINI_PLUS_RECOVERY_MIN_EVENTS) return _health_frames > 0;
+    return errors * 100 <= uint32_t(_recovery_error_percent) * total;
+}
+
+/**
+ * Start a new health window.
+ */
+void TFminiPlus::reset_health() {
+    _health_frames = 0;
+    _health_errors = 0;
+    _health_discarded = 0;
+    _recovery_window_start = millis();
+}
+
+/**
+ * Take one recovery step.
+ *
+ * @param level: Step to take.
+ */
+void TFminiPlus::run_recovery_step(tfminiplus_recovery_level_t level) {
+    switch (level) {
+        case TFMINI_PLUS_RECOVERY_RESTART_OUTPUT:
+            enable_output(false);
+            enable_output(true);
+            break;
+        case TFMINI_PLUS_RECOVERY_RESET:
+            reset_system();
+            break;
+        case TFMINI_PLUS_RECOVERY_BAUDRATE:
+            recover_baudrate();
+            break;
+        default:
+            break;
+    }
+    drain_receive_buffer();
+}
+
+/**
+ * Find the baudrate the lidar is using and move it back to the expected one.
+ * Each standard baudrate is tried on the host until the lidar answers a version request.
+ *
+ * @return: True if the lidar was found and is back at the expected baudrate.
+ */
+bool TFminiPlus::recover_baudrate() {
+    static const uint32_t baudrates[] = {TFMINI_PLUS_BAUDRATE_115200, TFMINI_PLUS_BAUDRATE_921600, TFMINI_PLUS_BAUDRATE_460800,
+                                         TFMINI_PLUS_BAUDRATE_256000, TFMINI_PLUS_BAUDRATE_230400, TFMINI_PLUS_BAUDRATE_57600,
+                                         TFMINI_PLUS_BAUDRATE_38400,  TFMINI_PLUS_BAUDRATE_19200,  TFMINI_PLUS_BAUDRATE_9600};
+    uint32_t expected = _recovery_baudrate;
+
+    if (switch_host_baudrate(expected, _recovery_host_baudrate_callback)) return true;
+
+    for (uint8_t i = 0; i < sizeof(baudrates) / sizeof(baudrates[0]); i++) {
+        if (baudrates[i] == expected or not switch_host_baudrate(baudrates[i], _recovery_host_baudrate_callback)) continue;
+        return negotiate_baudrate(tfminiplus_baudrate_t(expected), tfminiplus_baudrate_t(baudrates[i]), _recovery_host_baudrate_callback);
+    }
+
+    // Not found anywhere; stay at the expected baudrate for the next attempt
+    _recovery_host_baudrate_callback(expected);
+    set_host_baudrate(expected);
+    return false;
+}
+#endif
+
+/**
+ * Get the most recent valid data frame without reading from the lidar.
+ * Every frame decoded by any read call is published here; views from poll_frame() are not.
+ * The copy is protected by a sequence counter rather than a lock, so it is safe to call from
+ * another task while frames are being read, and it never waits on the reader.
+ * Do not call from an interrupt that can preempt a read on the same core.
+ *
+ * @param data: Container for the newest frame.
+ * @return: True if a frame was copied; false if none has been read yet, or if every attempt
+ *      overlapped a new frame being published.
+ */
+bool TFminiPlus::get_latest(tfminiplus_data_t &data) {
+    for (uint8_t attempt = 0; attempt < TFMINI_PLUS_LATEST_READ_ATTEMPTS; attempt++) {
+        uint32_t sequence = _latest_sequence;
+        if (sequence == 0) return false;
+        if (sequence & 1) continue;
+
+        TFMINI_PLUS_MEMORY_BARRIER();
+        tfminiplus_data_t copy = _latest_data;
+        TFMINI_PLUS_MEMORY_BARRIER();
+
+        if (sequence == _latest_sequence) {
+            data = copy;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Get the number of frames published for get_latest().
+ * The count changes whenever a new frame is available, so it can be used to tell repeats apart.
+ *
+ * @return: Number of valid frames decoded since begin().
+ */
+uint32_t TFminiPlus::get_latest_count() { return _latest_sequence >> 1; }
+
+/**
+ * Make a frame available to get_latest().
+ * The sequence counter is odd while the copy is being written.
+ *
+ * @param data: Frame to publish.
+ */
+void TFminiPlus::publish_latest(const tfminiplus_data_t &data) {
+    _latest_sequence = _latest_sequence + 1;
+    TFMINI_PLUS_MEMORY_BARRIER();
+    _latest_data = data;
+    TFMINI_PLUS_MEMORY_BARRIER();
+    _latest_sequence = _latest_sequence + 1;
+}
+
+#if defined(ESP32)
+/**
+ * Read the lidar in a dedicated FreeRTOS task.
+ * Frames are published to get_latest(). Once started, no other read calls may be made.
+ *
+ * @param in_mm_format: True to request the data frames in mm units (I2C only).
+ * @param core: Core to pin the task to, or tskNO_AFFINITY.
+ * @param priority: FreeRTOS priority of the task.
+ * @param stack_size: Stack size of the task in bytes.
+ * @return: True if the task was started.
+ */
+bool TFminiPlus::start_task(bool in_mm_format, BaseType_t core, UBaseType_t priority, uint32_t stack_size) {
+    if (_task) return false;
+
+    _task_mm_format = in_mm_format;
+    _task_stopping = false;
+    return xTaskCreatePinnedToCore(run_task, "tfminiplus", stack_size, this, priority, &_task, core) == pdPASS;
+}
+
+/**
+ * Stop the acquisition task.
+ * The task is asked to stop and waited for, so it is never deleted in the middle of a transaction.
+ */
+void TFminiPlus::stop_task() {
+    if (not _task) return;
+    _task_stopping = true;
+    while (_task_stopping) vTaskDelay(1);
+    _task = 0;
+}
+
+/**
+ * Body of the acquisition task.
+ * UART frames are drained without blocking; I2C frames are requested and waited for.
+ *
+ * @param parameter: Lidar that owns the task.
+ */
+void TFminiPlus::run_task(void *parameter) {
+    TFminiPlus *lidar = static_cast<TFminiPlus *>(parameter);
+    tfminiplus_data_t data;
+
+    while (not lidar->_task_stopping) {
+        if (lidar->_communications_mode == TFMINI_PLUS_UART) {
+            while (lidar->poll(data)) {
+            }
+        } else {
+            lidar->read_data(data, lidar->_task_mm_format);
+        }
+        vTaskDelay(1);
+    }
+
+    // Tell stop_task() the loop has finished before the task deletes itself
+    lidar->_task_stopping = false;
+    vTaskDelete(0);
+}
+#endif
+
+/**
+ * Choose what happens to waiting UART data when a command is sent (UART only).
+ *  TFMINI_PLUS_UART_DRAIN_AND_FLUSH - Waiting bytes are dropped and TX is flushed; the original behaviour.
+ *  TFMINI_PLUS_UART_DRAIN - Waiting bytes are dropped without blocking on TX. This is the default.
+ *  TFMINI_PLUS_UART_ORDERED - Nothing is dropped. Frames read while a command is outstanding are kept
+ *      and tagged with TFMINI_PLUS_DATA_BEFORE_COMMAND or TFMINI_PLUS_DATA_DURING_COMMAND.
+ *      Triggers and data requests are answered with a data frame, so frames after them are not tagged.
+ *
+ * @param policy: Policy to use for later sends.
+ */
+void TFminiPlus::set_uart_policy(tfminiplus_uart_policy_t policy) { _uart_policy = policy; }
+
+/**
+ * Run every valid data frame through a filter pipeline before it is returned.
+ * Applies to every read that decodes frames: poll(), read_data(), collect_data(), both forms of
+ * read_frames(), and parse_buffer() with a callback. poll_frame() returns the raw frame and is not filtered.
+ * Frames rejected by a stage are reported as invalid. Must be called after begin().
+ *
+ * @param filter: First stage of the pipeline, or null to disable filtering.
+ */
+void TFminiPlus::set_filter(TFminiPlusFilter *filter) { _filter = filter; }
+
+/**
+ * Read a data frame from the lidar.
+ * If using the UART interface, frames are continually sent and do not need to be specifically requested.
+ *
+ * @param in_mm_format: True to request the data frame in mm units (I2C only).
+ * @return: Data container that includes distance, strength, and temperature measurements.
+ */
+tfminiplus_data_t TFminiPlus::get_data(bool in_mm_format) {
+    tfminiplus_data_t data;
+    read_data(data, in_mm_format);
+    return data;
+}
+
+/**
+ * Read a data frame from the lidar.
+ * If using the UART interface, frames are continually sent and do not need to be specifically requested.
+ *
+ * @param in_mm_format: True to request the data frame in mm units (I2C only).
+ * @return: Distance in cm/mm (depending on configuration).
+ */
+uint16_t TFminiPlus::get_distance(bool in_mm_format) { return get_data(in_mm_format).distance; }
+
+/**
+ * Read in a response frame from the lidar.
+ * Data frames are read in normally with I2C mode after a request.
+ * In UART mode, frames are sent in when available.
+ *
+ * @param data: Data frame to read the lidar output into.
+ * @return: True if the response was received correctly.
+ */
+bool TFminiPlus::read_data_response(tfminiplus_data_t &data) {
+    bool result = false;
+
+    // Grab the data
+    uint8_t response[TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE];
+    if (_communications_mode == TFMINI_PLUS_UART) {
+        // Drain the backlog first; only wait for a new frame if nothing was buffered
+        TFminiPlusFrame frame;
+        if (_read_mode == TFMINI_PLUS_READ_LATEST and uart_receive_frame(frame)) return parse_data_frame(frame.get_raw(), data);
+        result = uart_receive_data(response, sizeof(response));
+    } else {
+        result = receive_response(response, sizeof(response), TFMINI_PLUS_GET_DATA);
+        _frame_time = micros();
+    }
+
+    // Only decode frames that arrived, so timeouts are not also counted as invalid frames
+    result = result and parse_data_frame(response, data);
+    return result;
+}
+
+/**
+ * Convert a raw data frame into measurement values.
+ *
+ * @param frame: Raw 9-byte data frame.
+ * @param data: Data container to put the measurements into.
+ * @return: True if the measurements are within their valid ranges.
+ */
+bool TFminiPlus::parse_data_frame(const uint8_t *frame, tfminiplus_data_t &data) {
+    TFminiPlusFrame view(frame);
+    data.distance = view.get_distance();
+    data.strength = view.get_strength();
+    data.temperature = view.get_temperature();
+
+    // The lidar integrates over a whole frame period and sends the result at its end
+    data.timestamp = _frame_time;
+    data.sample_time = _frame_time;
+    data.flags = _frame_flags;
+    data.sample_time -= _sample_offset;
+
+    bool valid = view.is_valid();
+    if (valid and _filter) valid = _filter->apply(data);
+
+    if (valid) {
+        TFMINI_PLUS_COUNT(frames_ok);
+        publish_latest(data);
+#if TFMINI_PLUS_HAS_EXTRAS
+        if (_threshold_callback or _change_callback) evaluate_events(data);
+#endif
+    } else {
+        TFMINI_PLUS_COUNT(invalid_frames);
+    }
+    return valid;
+}
+
+#if TFMINI_PLUS_HAS_EXTRAS
+/**
+ * Set the IO mode of the lidar.
+ * Changes will not occur until settings have been saved.
+ * Modes:
+ *  0 - Standard: Output is transmitted over UART or I2C.
+ *  1 - IO LN/HF - Output pin is high if the measured distance is above the defined distance; otherwise low.
+ *  2 - IO HN/LF - Output pin is low if the measured distance is above the defined distance; otherwise high.
+ *
+ * @param mode: Output mode of the lidar [0-2].
+ * @param critical_distance: Threshold distance in cm for the near/far zones when using IO modes.
+ * @param hysteresis: Hysteresis in cm used when switching between near/far zones when using IO modes.
+ * @return: True if the mode change was received successfully.
+ */
+bool TFminiPlus::set_io_mode(tfminiplus_mode_t mode, uint16_t critical_distance, uint16_t hysteresis) {
+    uint8_t arguments[5];
+    arguments[0] = mode;
+    arguments[1] = uint8_t(critical_distance);
+    arguments[2] = critical_distance >> 8;
+    arguments[3] = uint8_t(hysteresis);
+    arguments[4] = hysteresis >> 8;
+
+    return send_command(TFMINI_PLUS_SET_IO_MODE, arguments, TFMINI_PLUS_PACK_LENGTH_SET_IO_MODE);
+}
+
+/**
+ * Set the communication mode for the lidar.
+ * Changes are applied immediately.
+ * The library will switch to use the mode specified if the change was successfully applied.
+ *
+ * @param mode: Communication mode. [UART, I2C]
  * @return: True if the settings were saved correctly.
  */
 bool TFminiPlus::set_communication_interface(tfminiplus_communication_mode_t mode) {
     bool result;
-    send_command(TFMINI_PLUS_SET_COMMUNICATION_INTERFACE, (uint8_t *)&mode, TFMINI_PLUS_PACK_LENGTH_SET_COMMUNICATION_INTERFACE);
+    send_packet(tfminiplus_make_packet_u8(TFMINI_PLUS_SET_COMMUNICATION_INTERFACE, mode));
 
     result = save_settings();
     if (result) {
@@ -531,7 +2105,9 @@ bool TFminiPlus::set_communication_interface(tfminiplus_communication_mode_t mod
     }
     return result;
 }
+#endif
 
+#if TFMINI_PLUS_HAS_CONFIG
 /**
  * Enable or disable the lidar output.
  * The datasheet is unclear as to whether the lidar will still respond to communication or data requests if output
@@ -542,15 +2118,22 @@ bool TFminiPlus::set_communication_interface(tfminiplus_communication_mode_t mod
  * @return: True if the command was received successfully.
  */
 bool TFminiPlus::enable_output(bool output_enabled) {
-    bool result = false;
+    if ((_settings_known & TFMINI_PLUS_SETTING_OUTPUT_ENABLED) and _settings.output_enabled == output_enabled) return true;
 
-    send_command(TFMINI_PLUS_ENABLE_DATA_OUTPUT, (uint8_t *)&output_enabled, TFMINI_PLUS_PACK_LENGTH_ENABLE_DATA_OUTPUT);
-    do_i2c_wait();
+    bool result = false;
+    tfminiplus_packet_t<TFMINI_PLUS_PACK_LENGTH_ENABLE_DATA_OUTPUT> packet = tfminiplus_make_packet_u8(TFMINI_PLUS_ENABLE_DATA_OUTPUT, output_enabled);
+    send_packet(packet);
 
     uint8_t response[TFMINI_PLUS_PACK_LENGTH_ENABLE_DATA_OUTPUT];
-    if (receive(response, sizeof(response))) {
+    if (receive_response(response, sizeof(response), TFMINI_PLUS_ENABLE_DATA_OUTPUT)) {
         if (output_enabled == response[3]) result = true;
     }
+
+    if (result) {
+        remember_setting(packet.data);
+    } else {
+        _settings_known &= ~TFMINI_PLUS_SETTING_OUTPUT_ENABLED;
+    }
     return result;
 }
 
@@ -563,11 +2146,10 @@ bool TFminiPlus::enable_output(bool output_enabled) {
 bool TFminiPlus::save_settings() {
     bool result = false;
 
-    send_command(TFMINI_PLUS_SAVE_SETTINGS);
-    do_i2c_wait();
+    send_packet(TFMINI_PLUS_PACKET_SAVE_SETTINGS);
 
     uint8_t response[TFMINI_PLUS_PACK_LENGTH_SAVE_SETTINGS_RESPONSE];
-    if (receive(response, sizeof(response))) {
+    if (receive_response(response, sizeof(response), TFMINI_PLUS_SAVE_SETTINGS)) {
         if (response[3] == 0) {
             result = true;
         }
@@ -584,17 +2166,21 @@ bool TFminiPlus::save_settings() {
 bool TFminiPlus::reset_system() {
     bool result = false;
 
-    send_command(TFMINI_PLUS_SYSTEM_RESET);
-    do_i2c_wait();
+    send_packet(TFMINI_PLUS_PACKET_SYSTEM_RESET);
 
     uint8_t response[TFMINI_PLUS_PACK_LENGTH_SYSTEM_RESET_RESPONSE];
-    if (receive(response, sizeof(response))) {
+    if (receive_response(response, sizeof(response), TFMINI_PLUS_SYSTEM_RESET)) {
         if (response[3] == 0) result = true;
     }
 
+    // Unsaved settings are lost in a reset, and the cache cannot tell which those were
+    if (result) _settings_known = 0;
+
     return result;
 }
+#endif
 
+#if TFMINI_PLUS_HAS_EXTRAS
 /**
  * Reset the lidar's settings back to their factory defaults.
  * The factory reset does not affect the communication mode.
@@ -604,34 +2190,617 @@ bool TFminiPlus::reset_system() {
 bool TFminiPlus::factory_reset() {
     bool result = false;
 
-    send_command(TFMINI_PLUS_RESTORE_FACTORY_SETTINGS);
-    do_i2c_wait();
+    send_packet(TFMINI_PLUS_PACKET_RESTORE_FACTORY_SETTINGS);
 
     uint8_t response[TFMINI_PLUS_PACK_LENGTH_RESTORE_FACTORY_SETTINGS_RESPONSE];
-    if (receive(response, sizeof(response))) {
+    if (receive_response(response, sizeof(response), TFMINI_PLUS_RESTORE_FACTORY_SETTINGS)) {
         if (response[3] == 0) result = true;
     }
+
+    if (result) {
+        tfminiplus_settings_t defaults = {TFMINI_PLUS_FRAMERATE_100HZ, TFMINI_PLUS_BAUDRATE_115200, TFMINI_PLUS_OUTPUT_CM, true};
+        assume_settings(defaults);
+    }
     return result;
 }
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+#if TFMINI_PLUS_HAS_CONFIG
+/**
+ * Write a set of settings to the lidar and save them.
+ * Settings that the lidar is known to have already are skipped, and nothing is saved if none are left.
+ * Over UART the commands are sent in one write and their echoes checked afterwards; over I2C each
+ * command is answered before the next, since the lidar only keeps its latest response.
+ * A baudrate change takes effect once saved, so the host UART must be switched afterwards.
+ *
+ * Example:
+ *  tfminiplus_settings_t settings = {TFMINI_PLUS_FRAMERATE_250HZ, TFMINI_PLUS_BAUDRATE_115200, TFMINI_PLUS_OUTPUT_MM, true};
+ *  lidar.configure(settings, TFMINI_PLUS_SETTING_FRAMERATE | TFMINI_PLUS_SETTING_OUTPUT_FORMAT);
+ *
+ * @param settings: Settings to write.
+ * @param fields: Settings to apply, from TFMINI_PLUS_SETTING. Others are left alone.
+ * @return: True if every command was echoed correctly and the settings were saved.
+ */
+bool TFminiPlus::configure(const tfminiplus_settings_t &settings, uint8_t fields) {
+    uint8_t packets[4][TFMINI_PLUS_MAXIMUM_PACKET_SIZE];
+    uint8_t count = build_configuration(settings, fields, packets);
+    if (count == 0) return true;
+
+    bool result = true;
+    if (_communications_mode == TFMINI_PLUS_UART) {
+        uint8_t batch[sizeof(packets)];
+        uint8_t size = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            memcpy(&batch[size], packets[i], packets[i][TFMINI_PLUS_PACKET_POS_LENGTH]);
+            size += packets[i][TFMINI_PLUS_PACKET_POS_LENGTH];
+        }
+        send(batch, size);
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t size = packets[i][TFMINI_PLUS_PACKET_POS_LENGTH];
+        tfminiplus_command_t command = tfminiplus_command_t(packets[i][TFMINI_PLUS_PACKET_POS_COMMAND]);
+        if (_communications_mode == TFMINI_PLUS_I2C) send(packets[i], size);
+
+        // Echoes arrive in the order the commands were sent
+        uint8_t response[TFMINI_PLUS_MAXIMUM_PACKET_SIZE];
+        if (receive_response(response, size, command) and validate_response(packets[i], response, size)) {
+            remember_setting(packets[i]);
+        } else {
+            _settings_known &= ~get_setting_field(command);
+            result = false;
+        }
+    }
+
+    // A partly applied configuration is not saved
+    return result and save_settings();
+}
+
+/**
+ * Queue a set of settings to be written and saved by service() without blocking.
+ * Works like configure(), but each lidar in an array can be configured at the same time.
+ * Check is_configuring() and get_configuration_result() to find out when and how it finished.
+ *
+ * @param settings: Settings to write.
+ * @param fields: Settings to apply, from TFMINI_PLUS_SETTING. Others are left alone.
+ * @return: True if the commands were queued, or nothing needed to change.
+ */
+bool TFminiPlus::queue_configuration(const tfminiplus_settings_t &settings, uint8_t fields) {
+    if (_configuration_pending > 0) return false;
+
+    uint8_t packets[4][TFMINI_PLUS_MAXIMUM_PACKET_SIZE];
+    uint8_t count = build_configuration(settings, fields, packets);
+    _configuration_ok = true;
+    if (count == 0) return true;
+    if (count > TFMINI_PLUS_COMMAND_QUEUE_SIZE - _queue_count) return false;
+
+    _configuration_pending = count;
+    for (uint8_t i = 0; i < count; i++) {
+        queue_command(tfminiplus_command_t(packets[i][TFMINI_PLUS_PACKET_POS_COMMAND]), &packets[i][TFMINI_PLUS_PACKET_POS_COMMAND + 1],
+                      packets[i][TFMINI_PLUS_PACKET_POS_LENGTH], handle_configuration_response, this);
+    }
+    return true;
+}
+
+/**
+ * Check whether a queued configuration is still being written.
+ *
+ * @return: True until the last command of the configuration has completed.
+ */
+bool TFminiPlus::is_configuring() { return _configuration_pending > 0; }
+
+/**
+ * Get the outcome of the last queued configuration.
+ *
+ * @return: True if every command was echoed correctly and the settings were saved.
+ */
+bool TFminiPlus::get_configuration_result() { return _configuration_ok; }
+#endif
+
+/**
+ * Tell the driver which settings the lidar already has, without sending anything.
+ * Useful when the lidar was configured and saved beforehand, so configure() can skip them.
+ *
+ * @param settings: Settings the lidar is using.
+ * @param fields: Settings that are known, from TFMINI_PLUS_SETTING.
+ */
+void TFminiPlus::assume_settings(const tfminiplus_settings_t &settings, uint8_t fields) {
+    if (fields & TFMINI_PLUS_SETTING_FRAMERATE) {
+        _settings.framerate = settings.framerate;
+        remember_framerate(settings.framerate);
+    }
+    if (fields & TFMINI_PLUS_SETTING_BAUDRATE) _settings.baudrate = settings.baudrate;
+    if (fields & TFMINI_PLUS_SETTING_OUTPUT_FORMAT) {
+        _settings.output_format = settings.output_format;
+        _parser.set_output_format(settings.output_format);
+    }
+    if (fields & TFMINI_PLUS_SETTING_OUTPUT_ENABLED) _settings.output_enabled = settings.output_enabled;
+    _settings_known |= fields & TFMINI_PLUS_SETTING_ALL;
+}
+
+/**
+ * Get the settings the driver has written to the lidar.
+ * Only the fields in get_known_settings() are meaningful.
+ *
+ * @return: Copy of the cached settings.
+ */
+tfminiplus_settings_t TFminiPlus::get_settings() { return _settings; }
+
+/**
+ * Get which cached settings are known to match the lidar.
+ *
+ * @return: Mask of TFMINI_PLUS_SETTING values.
+ */
+uint8_t TFminiPlus::get_known_settings() { return _settings_known; }
+
+/**
+ * Drop the cached settings and firmware version, so the next setters and get_version() talk to the lidar.
+ * Call this if the lidar may have been changed behind the driver's back, eg. after a power cycle.
+ */
+void TFminiPlus::forget_settings() {
+    _settings_known = 0;
+    _version_known = false;
+}
+
+#if TFMINI_PLUS_HAS_CONFIG
+/**
+ * Build the commands needed to move the lidar to a set of settings.
+ * Settings already known to match are left out. The baudrate goes last, as it only takes effect once saved.
+ *
+ * @param settings: Settings to write.
+ * @param fields: Settings to apply, from TFMINI_PLUS_SETTING.
+ * @param packets: Container for up to four packets.
+ * @return: Number of packets built.
+ */
+uint8_t TFminiPlus::build_configuration(const tfminiplus_settings_t &settings, uint8_t fields, uint8_t packets[][TFMINI_PLUS_MAXIMUM_PACKET_SIZE]) {
+    uint8_t count = 0;
+    uint8_t changed = fields;
+    if (_settings.framerate == settings.framerate) changed &= ~(_settings_known & TFMINI_PLUS_SETTING_FRAMERATE);
+    if (_settings.baudrate == settings.baudrate) changed &= ~(_settings_known & TFMINI_PLUS_SETTING_BAUDRATE);
+    if (_settings.output_format == settings.output_format) changed &= ~(_settings_known & TFMINI_PLUS_SETTING_OUTPUT_FORMAT);
+    if (_settings.output_enabled == settings.output_enabled) changed &= ~(_settings_known & TFMINI_PLUS_SETTING_OUTPUT_ENABLED);
+
+    if (changed & TFMINI_PLUS_SETTING_FRAMERATE) {
+        uint8_t arguments[2] = {uint8_t(settings.framerate), uint8_t(settings.framerate >> 8)};
+        tfminiplus_build_packet(packets[count++], TFMINI_PLUS_SET_FRAME_RATE, arguments, TFMINI_PLUS_PACK_LENGTH_SET_FRAME_RATE);
+    }
+    if (changed & TFMINI_PLUS_SETTING_OUTPUT_FORMAT) {
+        uint8_t arguments[1] = {uint8_t(settings.output_format)};
+        tfminiplus_build_packet(packets[count++], TFMINI_PLUS_SET_OUTPUT_FORMAT, arguments, TFMINI_PLUS_PACK_LENGTH_SET_OUTPUT_FORMAT);
+    }
+    if (changed & TFMINI_PLUS_SETTING_OUTPUT_ENABLED) {
+        uint8_t arguments[1] = {uint8_t(settings.output_enabled)};
+        tfminiplus_build_packet(packets[count++], TFMINI_PLUS_ENABLE_DATA_OUTPUT, arguments, TFMINI_PLUS_PACK_LENGTH_ENABLE_DATA_OUTPUT);
+    }
+    if (changed & TFMINI_PLUS_SETTING_BAUDRATE) {
+        uint32_t baudrate = settings.baudrate;
+        uint8_t arguments[4] = {uint8_t(baudrate), uint8_t(baudrate >> 8), uint8_t(baudrate >> 16), uint8_t(baudrate >> 24)};
+        tfminiplus_build_packet(packets[count++], TFMINI_PLUS_SET_BAUD_RATE, arguments, TFMINI_PLUS_PACK_LENGTH_SET_BAUD_RATE);
+    }
+    return count;
+}
+
+/**
+ * Update the settings cache from a command that the lidar has echoed.
+ *
+ * @param packet: Settings command that was accepted by the lidar.
+ */
+void TFminiPlus::remember_setting(const uint8_t *packet) {
+    tfminiplus_command_t command = tfminiplus_command_t(packet[TFMINI_PLUS_PACKET_POS_COMMAND]);
+    const uint8_t *value = &packet[TFMINI_PLUS_PACKET_POS_COMMAND + 1];
+
+    switch (command) {
+        case TFMINI_PLUS_SET_FRAME_RATE:
+            _settings.framerate = tfminiplus_framerate_t(value[0] | (value[1] << 8));
+            // Kept for estimating sample times; assumes the new rate will be saved
+            remember_framerate(_settings.framerate);
+            break;
+        case TFMINI_PLUS_SET_BAUD_RATE:
+            _settings.baudrate = tfminiplus_baudrate_t(value[0] | (uint32_t(value[1]) << 8) | (uint32_t(value[2]) << 16) | (uint32_t(value[3]) << 24));
+            break;
+        case TFMINI_PLUS_SET_OUTPUT_FORMAT:
+            _settings.output_format = tfminiplus_output_format_t(value[0]);
+            _parser.set_output_format(_settings.output_format);
+            break;
+        case TFMINI_PLUS_ENABLE_DATA_OUTPUT:
+            _settings.output_enabled = value[0];
+            break;
+        default:
+            break;
+    }
+    _settings_known |= get_setting_field(command);
+}
+
+/**
+ * Get the setting written by a command.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @return: TFMINI_PLUS_SETTING value, or 0 if the command is not a cached setting.
+ */
+uint8_t TFminiPlus::get_setting_field(tfminiplus_command_t command) {
+    if (command == TFMINI_PLUS_SET_FRAME_RATE) return TFMINI_PLUS_SETTING_FRAMERATE;
+    if (command == TFMINI_PLUS_SET_BAUD_RATE) return TFMINI_PLUS_SETTING_BAUDRATE;
+    if (command == TFMINI_PLUS_SET_OUTPUT_FORMAT) return TFMINI_PLUS_SETTING_OUTPUT_FORMAT;
+    if (command == TFMINI_PLUS_ENABLE_DATA_OUTPUT) return TFMINI_PLUS_SETTING_OUTPUT_ENABLED;
+    return 0;
+}
+
+/**
+ * Completion callback for the commands queued by queue_configuration().
+ * Settings are saved once every command has been echoed correctly.
+ */
+void TFminiPlus::handle_configuration_response(tfminiplus_command_t command, bool success, const uint8_t *response, uint8_t size, void *context) {
+    TFminiPlus *lidar = static_cast<TFminiPlus *>(context);
+    (void)size;
+
+    if (command == TFMINI_PLUS_SAVE_SETTINGS) {
+        lidar->_configuration_ok = success;
+        lidar->_configuration_pending = 0;
+        return;
+    }
+
+    // A successful response has been checked to echo the command exactly
+    if (success) {
+        lidar->remember_setting(response);
+    } else {
+        lidar->_settings_known &= ~lidar->get_setting_field(command);
+        lidar->_configuration_ok = false;
+    }
+
+    lidar->_configuration_pending--;
+    if (lidar->_configuration_pending == 0 and lidar->_configuration_ok) {
+        lidar->_configuration_ok = lidar->queue_command(TFMINI_PLUS_SAVE_SETTINGS, handle_configuration_response, lidar);
+        if (lidar->_configuration_ok) lidar->_configuration_pending = 1;
+    }
+}
+#endif
 
+#if TFMINI_PLUS_HAS_EXTRAS
 /**
  * Calculate the effective accuracy of the lidar.
+ * Define TFMINI_PLUS_FIXED_POINT_ACCURACY to calculate this with the integer model instead of log10();
+ * see get_effective_accuracy_fixed().
  *
  * @param strength: Strength of the last reading.
  * @param frequency: Framerate of the lidar.
  * @return: Effective accuracy of the lidar in cm.
  */
 float TFminiPlus::get_effective_accuracy(uint16_t strength, uint16_t frequency) {
+#ifdef TFMINI_PLUS_FIXED_POINT_ACCURACY
+    return get_effective_accuracy_fixed(strength, frequency) / 100.0;
+#else
     float x = log10(strength);
     float y = log10(frequency);
 
     float ranging_accuracy = TFMINI_PLUS_P00 + TFMINI_PLUS_P10 * x + TFMINI_PLUS_P01 * y + TFMINI_PLUS_P20 * x * x + TFMINI_PLUS_P11 * x * y;
     return ranging_accuracy;
+#endif
 }
 
-void TFminiPlus::dump_serial_cache() {
-    while (_stream->available()) {
-        _stream->read();
+/**
+ * Calculate the effective accuracy of the lidar at its current framerate.
+ * The framerate is the last one set or assumed; see assume_settings().
+ *
+ * @param strength: Strength of the last reading.
+ * @return: Effective accuracy of the lidar in cm.
+ */
+float TFminiPlus::get_effective_accuracy(uint16_t strength) { return get_effective_accuracy(strength, _framerate); }
+
+/**
+ * Calculate the effective accuracy of the lidar using integer maths only.
+ * This is the same model as get_effective_accuracy(), evaluated in Q12 fixed point with a table-based log10.
+ * The result is within 0.01 cm of the float version across the full strength and framerate ranges.
+ *
+ * @param strength: Strength of the last reading.
+ * @param frequency: Framerate of the lidar.
+ * @return: Effective accuracy of the lidar in hundredths of a cm, or TFMINI_PLUS_ACCURACY_UNKNOWN if either input is 0.
+ */
+int16_t TFminiPlus::get_effective_accuracy_fixed(uint16_t strength, uint16_t frequency) {
+    if (strength == 0 or frequency == 0) return TFMINI_PLUS_ACCURACY_UNKNOWN;
+
+    int32_t x = calculate_log10_fixed(strength);
+    int32_t y = calculate_log10_fixed(frequency);
+
+    int32_t ranging_accuracy = TFMINI_PLUS_P00_Q12;
+    ranging_accuracy += (TFMINI_PLUS_P10_Q12 * x + TFMINI_PLUS_P01_Q12 * y) >> 12;
+    ranging_accuracy += (TFMINI_PLUS_P20_Q12 * ((x * x) >> 12)) >> 12;
+    ranging_accuracy += (TFMINI_PLUS_P11_Q12 * ((x * y) >> 12)) >> 12;
+
+    return (ranging_accuracy * 100 + 2048) >> 12;
+}
+
+/**
+ * Calculate the effective accuracy of the lidar at its current framerate using integer maths only.
+ *
+ * @param strength: Strength of the last reading.
+ * @return: Effective accuracy of the lidar in hundredths of a cm, or TFMINI_PLUS_ACCURACY_UNKNOWN.
+ */
+int16_t TFminiPlus::get_effective_accuracy_fixed(uint16_t strength) { return get_effective_accuracy_fixed(strength, _framerate); }
+
+/**
+ * Calculate log10 of an integer in Q12 fixed point.
+ * The integer part of log2 comes from the position of the highest set bit; the fractional part is
+ * interpolated from TFMINI_PLUS_LOG2_TABLE.
+ *
+ * @param value: Value to take the logarithm of. Must be greater than 0.
+ * @return: log10(value) * 4096.
+ */
+int32_t TFminiPlus::calculate_log10_fixed(uint16_t value) {
+    int32_t exponent = 15;
+    while (not(value & 0x8000)) {
+        value <<= 1;
+        exponent--;
     }
+
+    // value is now 1.fffffffffffffff in binary; the top 4 fraction bits pick the table entry
+    uint8_t index = (value >> 11) & 0x0F;
+    int32_t remainder = value & 0x07FF;
+    int32_t low = pgm_read_word(&TFMINI_PLUS_LOG2_TABLE[index]);
+    int32_t high = pgm_read_word(&TFMINI_PLUS_LOG2_TABLE[index + 1]);
+
+    int32_t log2_value = (exponent << 12) + low + (((high - low) * remainder) >> 11);
+    return (log2_value * TFMINI_PLUS_LOG10_2_Q12) >> 12;
+}
+#endif
+
+/**
+ * Get the I2C bus the lidar is connected to.
+ *
+ * @return: Pointer to the bus given to begin().
+ */
+TwoWire *TFminiPlus::get_bus() { return _bus; }
+
+void TFminiPlus::dump_serial_cache() {
+    drain_receive_buffer();
     _stream->flush();
 }
+
+/**
+ * Discard everything waiting to be parsed without waiting for transmission to finish.
+ * Bytes are read out in blocks rather than one call at a time.
+ */
+void TFminiPlus::drain_receive_buffer() {
+    if (_ring_buffer) {
+        TFMINI_PLUS_COUNT_BY(bytes_discarded, uint8_t(_ring_head - _ring_tail));
+        _ring_tail = _ring_head;
+    }
+
+    uint8_t scratch[16];
+    int waiting;
+    while ((waiting = _stream->available()) > 0) {
+        size_t count = _stream->readBytes(scratch, waiting < int(sizeof(scratch)) ? waiting : sizeof(scratch));
+        TFMINI_PLUS_COUNT_BY(bytes_discarded, count);
+        if (count == 0) break;
+    }
+    _parser.reset();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#if TFMINI_PLUS_HAS_CONFIG
+/**
+ * Queue a command to be sent by service() without blocking.
+ * The completion callback is called from service() once the echo has been received and validated,
+ * or once the command has timed out.
+ * Blocking configuration methods should not be used while queued commands are outstanding.
+ *
+ * @param command: 8-bit command to send; see TFMINI_PLUS_COMMANDS.
+ * @param arguments: Container containing the command arguments in little-endian format.
+ * @param size: Total number of bytes to send, including header and checksum.
+ * @param callback: Function to call when the command completes. May be null.
+ * @param context: User pointer passed back to the callback.
+ * @return: True if the command was added to the queue.
+ */
+bool TFminiPlus::queue_command(tfminiplus_command_t command, uint8_t *arguments, uint8_t size, tfminiplus_command_callback_t callback,
+                               void *context) {
+    if (_queue_count >= TFMINI_PLUS_COMMAND_QUEUE_SIZE) return false;
+    if (size < TFMINI_PLUS_MINIMUM_PACKET_SIZE or size > TFMINI_PLUS_MAXIMUM_PACKET_SIZE) return false;
+
+    // Data requests answer with data frames, which are collected through read_data() instead
+    if (command == TFMINI_PLUS_GET_DATA or command == TFMINI_PLUS_TRIGGER_DETECTION) return false;
+
+    tfminiplus_queued_command_t &queued = _command_queue[(_queue_head + _queue_count) % TFMINI_PLUS_COMMAND_QUEUE_SIZE];
+    tfminiplus_build_packet(queued.packet, command, arguments, size);
+    queued.response_size = get_response_length(command);
+    queued.callback = callback;
+    queued.context = context;
+    _queue_count++;
+
+    return true;
+}
+
+/**
+ * Queue a command to be sent by service() without blocking.
+ * Only to be used with commands that do not take arguments.
+ *
+ * @param command: 8-bit command to send; see TFMINI_PLUS_COMMANDS.
+ * @param callback: Function to call when the command completes. May be null.
+ * @param context: User pointer passed back to the callback.
+ * @return: True if the command was added to the queue.
+ */
+bool TFminiPlus::queue_command(tfminiplus_command_t command, tfminiplus_command_callback_t callback, void *context) {
+    return queue_command(command, 0, TFMINI_PLUS_MINIMUM_PACKET_SIZE, callback, context);
+}
+
+/**
+ * Progress the command queue.
+ * Sends the next queued command, collects its response, and fires its callback.
+ * In I2C mode the response is polled for with the same adaptive backoff as the blocking commands.
+ * This never blocks, so it should be called regularly from the main loop.
+ * In UART mode, a data frame met while waiting for a response is held for the next poll() or read_data().
+ */
+void TFminiPlus::service() {
+    if (not _command_in_flight) {
+        if (_queue_count == 0) return;
+
+        tfminiplus_queued_command_t &next = _command_queue[_queue_head];
+        bool sent = send(next.packet, next.packet[TFMINI_PLUS_PACKET_POS_LENGTH]);
+
+        if (not sent or next.response_size == 0) {
+            finish_command(sent, 0, 0);
+        } else {
+            _command_in_flight = true;
+            _command_sent_time = millis();
+            _poll_delay = _latency.get_first_poll_delay(tfminiplus_command_t(next.packet[TFMINI_PLUS_PACKET_POS_COMMAND]));
+            _poll_interval = TFMINI_PLUS_I2C_POLL_INTERVAL_MIN;
+        }
+        return;
+    }
+
+    tfminiplus_queued_command_t &current = _command_queue[_queue_head];
+    tfminiplus_command_t command = tfminiplus_command_t(current.packet[TFMINI_PLUS_PACKET_POS_COMMAND]);
+
+    if (_communications_mode == TFMINI_PLUS_UART) {
+        // Stop at the first data frame so it is not lost; the response can be picked up next time
+        while (_command_in_flight and not _frame_stashed and bytes_available() > 0) {
+            if (parse_byte(read_byte()) == TFMINI_PLUS_FRAME_DATA) {
+                stash_frame();
+            }
+        }
+
+    } else if ((millis() - _command_sent_time) >= _poll_delay) {
+        uint8_t response[TFMINI_PLUS_MAXIMUM_PACKET_SIZE];
+        uint8_t size = current.response_size;
+
+        if (receive(response, size) and tfminiplus_is_response_for(response, size, command)) {
+            _latency.record(command, millis() - _command_sent_time);
+            bool result = validate_response(current.packet, response, size);
+            finish_command(result, result ? response : 0, result ? size : 0);
+            return;
+        }
+
+        // Not ready yet; back off before the next poll
+        _poll_delay += _poll_interval;
+        if (_poll_interval < TFMINI_PLUS_I2C_POLL_INTERVAL_MAX) _poll_interval <<= 1;
+    }
+
+    if (_command_in_flight and (millis() - _command_sent_time) >= tfminiplus_get_response_timeout(command)) {
+        TFMINI_PLUS_COUNT(timeouts);
+        _awaiting_response = false;
+        finish_command(false, 0, 0);
+    }
+}
+
+/**
+ * Get the number of commands waiting in the queue, including the one being processed.
+ *
+ * @return: Number of outstanding commands.
+ */
+uint8_t TFminiPlus::get_queued_commands() { return _queue_count; }
+
+/**
+ * Get the length of the response the lidar sends for a command.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @return: Number of bytes in the response, or 0 if no response is expected.
+ */
+uint8_t TFminiPlus::get_response_length(tfminiplus_command_t command) {
+    uint8_t length = 0;
+
+    switch (command) {
+        case TFMINI_PLUS_GET_DATA:
+        case TFMINI_PLUS_TRIGGER_DETECTION:
+            length = TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE;
+            break;
+        case TFMINI_PLUS_GET_VERSION:
+            length = TFMINI_PLUS_PACK_LENGTH_VERSION_RESPONSE;
+            break;
+        case TFMINI_PLUS_SYSTEM_RESET:
+            length = TFMINI_PLUS_PACK_LENGTH_SYSTEM_RESET_RESPONSE;
+            break;
+        case TFMINI_PLUS_SET_FRAME_RATE:
+            length = TFMINI_PLUS_PACK_LENGTH_SET_FRAME_RATE;
+            break;
+        case TFMINI_PLUS_SET_OUTPUT_FORMAT:
+            length = TFMINI_PLUS_PACK_LENGTH_SET_OUTPUT_FORMAT;
+            break;
+        case TFMINI_PLUS_SET_BAUD_RATE:
+            length = TFMINI_PLUS_PACK_LENGTH_SET_BAUD_RATE;
+            break;
+        case TFMINI_PLUS_ENABLE_DATA_OUTPUT:
+            length = TFMINI_PLUS_PACK_LENGTH_ENABLE_DATA_OUTPUT;
+            break;
+        case TFMINI_PLUS_SET_COMMUNICATION_INTERFACE:
+            length = TFMINI_PLUS_PACK_LENGTH_SET_COMMUNICATION_INTERFACE;
+            break;
+        case TFMINI_PLUS_SET_I2C_ADDRESS:
+            length = TFMINI_PLUS_PACK_LENGTH_SET_I2C_ADDRESS;
+            break;
+        case TFMINI_PLUS_SET_IO_MODE:
+            length = TFMINI_PLUS_PACK_LENGTH_SET_IO_MODE;
+            break;
+        case TFMINI_PLUS_RESTORE_FACTORY_SETTINGS:
+            length = TFMINI_PLUS_PACK_LENGTH_RESTORE_FACTORY_SETTINGS_RESPONSE;
+            break;
+        case TFMINI_PLUS_SAVE_SETTINGS:
+            length = TFMINI_PLUS_PACK_LENGTH_SAVE_SETTINGS_RESPONSE;
+            break;
+    }
+
+    return length;
+}
+
+/**
+ * Check that a response is a correct answer to a command packet.
+ * Setters must echo their arguments back; save, reset, and factory reset must report a status of 0.
+ *
+ * @param packet: Command packet that was sent.
+ * @param response: Response received from the lidar; the checksum is assumed to be verified.
+ * @param size: Number of bytes in the response.
+ * @return: True if the response confirms the command.
+ */
+bool TFminiPlus::validate_response(const uint8_t *packet, const uint8_t *response, uint8_t size) {
+    uint8_t command = packet[TFMINI_PLUS_PACKET_POS_COMMAND];
+    bool result = response[TFMINI_PLUS_PACKET_POS_START] == TFMINI_PLUS_FRAME_START and response[TFMINI_PLUS_PACKET_POS_LENGTH] == size and
+                  response[TFMINI_PLUS_PACKET_POS_COMMAND] == command;
+    if (not result) return result;
+
+    if (command == TFMINI_PLUS_SAVE_SETTINGS or command == TFMINI_PLUS_SYSTEM_RESET or command == TFMINI_PLUS_RESTORE_FACTORY_SETTINGS) {
+        result = response[3] == 0;
+    } else if (size == packet[TFMINI_PLUS_PACKET_POS_LENGTH]) {
+        for (uint8_t i = TFMINI_PLUS_PACKET_POS_COMMAND + 1; i < size - 1; i++) result &= response[i] == packet[i];
+    }
+
+    return result;
+}
+
+/**
+ * Match a command response received over UART against the command in flight.
+ * Responses that do not belong to the command in flight are ignored.
+ *
+ * @param response: Complete response frame with a verified checksum.
+ * @param size: Number of bytes in the response.
+ */
+void TFminiPlus::handle_response(const uint8_t *response, uint8_t size) {
+    if (not _command_in_flight) return;
+
+    tfminiplus_queued_command_t &current = _command_queue[_queue_head];
+    tfminiplus_command_t command = tfminiplus_command_t(current.packet[TFMINI_PLUS_PACKET_POS_COMMAND]);
+    if (response[TFMINI_PLUS_PACKET_POS_COMMAND] != command or size != current.response_size) return;
+
+    _latency.record(command, millis() - _command_sent_time);
+    bool result = validate_response(current.packet, response, size);
+    finish_command(result, result ? response : 0, result ? size : 0);
+}
+
+/**
+ * Retire the command at the front of the queue and notify its callback.
+ * The command is removed before the callback runs, so the callback may queue further commands.
+ *
+ * @param success: True if the command was confirmed by the lidar.
+ * @param response: Validated response, or null.
+ * @param size: Number of bytes in the response.
+ */
+void TFminiPlus::finish_command(bool success, const uint8_t *response, uint8_t size) {
+    tfminiplus_queued_command_t finished = _command_queue[_queue_head];
+    _queue_head = (_queue_head + 1) % TFMINI_PLUS_COMMAND_QUEUE_SIZE;
+    _queue_count--;
+    _command_in_flight = false;
+
+    if (finished.callback) {
+        finished.callback(tfminiplus_command_t(finished.packet[TFMINI_PLUS_PACKET_POS_COMMAND]), success, response, size, finished.context);
+    }
+}
+#endif
@@ -4,11 +4,58 @@
 #include <Arduino.h>
 #include <Wire.h>
 
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 
+// Build profiles. Define TFMINI_PLUS_PROFILE as one of these for the whole build (eg. -DTFMINI_PLUS_PROFILE=1)
+// so the library and the sketch see the same class.
+#define TFMINI_PLUS_PROFILE_MINIMAL 1  // Reading data only: UART, I2C, ring buffer, block parsing, filters, and stats
+#define TFMINI_PLUS_PROFILE_CONFIG 2   // Adds settings commands, configure(), and the command queue
+#define TFMINI_PLUS_PROFILE_EXTRAS 3   // Adds everything else: accuracy, events, recovery, Pixhawk text, IO mode, etc.
+
+#ifndef TFMINI_PLUS_PROFILE
+#define TFMINI_PLUS_PROFILE TFMINI_PLUS_PROFILE_EXTRAS
+#endif
+
+#define TFMINI_PLUS_HAS_CONFIG (TFMINI_PLUS_PROFILE >= TFMINI_PLUS_PROFILE_CONFIG)
+#define TFMINI_PLUS_HAS_EXTRAS (TFMINI_PLUS_PROFILE >= TFMINI_PLUS_PROFILE_EXTRAS)
+
 const uint8_t TFMINI_PLUS_FRAME_START = 0x5A;
 const uint8_t TFMINI_PLUS_RESPONSE_FRAME_HEADER = 0x59;
 const uint8_t TFMINI_PLUS_MINIMUM_PACKET_SIZE = 4;
+const uint8_t TFMINI_PLUS_MAXIMUM_PACKET_SIZE = 9;
+const uint16_t TFMINI_PLUS_RAW_TEMPERATURE_LIMIT = 2848;
+const uint16_t TFMINI_PLUS_PIXHAWK_STRENGTH = 0xFFFE;       // Placeholder strength for Pixhawk frames, which carry none
+const uint16_t TFMINI_PLUS_PIXHAWK_RAW_TEMPERATURE = 2048;  // Placeholder raw temperature (0 C) for Pixhawk frames
+const uint8_t TFMINI_PLUS_PIXHAWK_MAXIMUM_LINE = 8;
+
+#ifndef TFMINI_PLUS_COMMAND_QUEUE_SIZE
+#define TFMINI_PLUS_COMMAND_QUEUE_SIZE 4
+#endif
+
+const unsigned long TFMINI_PLUS_RESPONSE_TIMEOUT = 200;
+const unsigned long TFMINI_PLUS_SLOW_RESPONSE_TIMEOUT = 500;
+const unsigned long TFMINI_PLUS_DATA_TIMEOUT = 10;  // Longest wait for a streamed UART data frame
+const uint8_t TFMINI_PLUS_I2C_POLL_INTERVAL_MIN = 1;
+const uint8_t TFMINI_PLUS_I2C_POLL_INTERVAL_MAX = 16;
+const uint8_t TFMINI_PLUS_LATENCY_SLOTS = 13;
+const uint8_t TFMINI_PLUS_NEGOTIATION_ATTEMPTS = 3;
+const uint8_t TFMINI_PLUS_LATEST_READ_ATTEMPTS = 4;
+const unsigned long TFMINI_PLUS_RECOVERY_WINDOW = 500;
+const uint8_t TFMINI_PLUS_RECOVERY_MAX_BACKOFF = 4;  // Longest wait is the window times 2^4
+const uint8_t TFMINI_PLUS_RECOVERY_MIN_EVENTS = 10;
+const uint8_t TFMINI_PLUS_RECOVERY_ERROR_PERCENT = 10;
+const uint8_t TFMINI_PLUS_ZONE_UNKNOWN = 0;
+const uint8_t TFMINI_PLUS_ZONE_NEAR = 1;
+const uint8_t TFMINI_PLUS_ZONE_FAR = 2;
+const uint16_t TFMINI_PLUS_DEFAULT_FRAMERATE = 100;
+const uint32_t TFMINI_PLUS_DEFAULT_BAUDRATE = 115200;
+const uint8_t TFMINI_PLUS_UART_BITS_PER_BYTE = 10;
+const unsigned long TFMINI_PLUS_BAUDRATE_SETTLE_TIME = 20;
 
 const float TFMINI_PLUS_P00 = 0.9758;
 const float TFMINI_PLUS_P01 = 1.175;
@@ -16,10 +63,58 @@ const float TFMINI_PLUS_P10 = -0.6072;
 const float TFMINI_PLUS_P20 = 0.09501;
 const float TFMINI_PLUS_P11 = -0.2904;
 
+// Q12 fixed-point copies of the accuracy model (4096 = 1.0)
+const int16_t TFMINI_PLUS_P00_Q12 = 3997;
+const int16_t TFMINI_PLUS_P01_Q12 = 4813;
+const int16_t TFMINI_PLUS_P10_Q12 = -2487;
+const int16_t TFMINI_PLUS_P20_Q12 = 389;
+const int16_t TFMINI_PLUS_P11_Q12 = -1189;
+const int16_t TFMINI_PLUS_LOG10_2_Q12 = 1233;
+const int16_t TFMINI_PLUS_ACCURACY_UNKNOWN = 0x7FFF;
+
+// Define TFMINI_PLUS_INTEGER_TEMPERATURE to keep float maths off the read path
+#ifdef TFMINI_PLUS_INTEGER_TEMPERATURE
+typedef int16_t tfminiplus_temperature_t;  // Hundredths of a degree C
+#else
+typedef float tfminiplus_temperature_t;  // Degrees C
+#endif
+
+/**
+ * Convert a raw temperature reading from the lidar.
+ *
+ * @param raw_temperature: Temperature as sent by the lidar, in 1/8 C steps offset by 256 C.
+ * @return: Temperature in the units of tfminiplus_temperature_t.
+ */
+inline tfminiplus_temperature_t tfminiplus_convert_temperature(uint16_t raw_temperature) {
+#ifdef TFMINI_PLUS_INTEGER_TEMPERATURE
+    return int16_t((int32_t(raw_temperature) * 25 + 1) / 2 - 25600);
+#else
+    return raw_temperature / 8.0f - 256;
+#endif
+}
+
+/**
+ * Convert a temperature back into the lidar's raw units.
+ * Exact for any temperature produced by tfminiplus_convert_temperature().
+ *
+ * @param temperature: Temperature in the units of tfminiplus_temperature_t.
+ * @return: Raw temperature reading.
+ */
+inline uint16_t tfminiplus_raw_temperature(tfminiplus_temperature_t temperature) {
+#ifdef TFMINI_PLUS_INTEGER_TEMPERATURE
+    return uint16_t((int32_t(temperature) + 25600) * 2 / 25);
+#else
+    return uint16_t((temperature + 256) * 8 + 0.5f);
+#endif
+}
+
 typedef struct {
     uint16_t distance;
     uint16_t strength;
-    float temperature;
+    tfminiplus_temperature_t temperature;
+    uint32_t timestamp;    // micros() when the frame's first byte arrived
+    uint32_t sample_time;  // Estimated micros() at the middle of the lidar's measurement
+    uint8_t flags;         // See TFMINI_PLUS_DATA_FLAGS
 } tfminiplus_data_t;
 
 typedef union {
@@ -98,75 +193,632 @@ typedef enum TFMINI_PLUS_BAUDRATE {
     TFMINI_PLUS_BAUDRATE_19200 = 19200,
     TFMINI_PLUS_BAUDRATE_38400 = 38400,
     TFMINI_PLUS_BAUDRATE_57600 = 57600,
-    TFMINI_PLUS_BAUDRATE_115200 = 115200
+    TFMINI_PLUS_BAUDRATE_115200 = 115200,
+    TFMINI_PLUS_BAUDRATE_230400 = 230400,
+    TFMINI_PLUS_BAUDRATE_256000 = 256000,
+    TFMINI_PLUS_BAUDRATE_460800 = 460800,
+    TFMINI_PLUS_BAUDRATE_921600 = 921600
 } tfminiplus_baudrate_t;
 
+/**
+ * Switches the host's UART to a new baudrate, eg. by calling Serial1.begin(baudrate).
+ * Used during baudrate negotiation, since a Stream cannot be reconfigured by the driver.
+ */
+typedef void (*tfminiplus_baudrate_callback_t)(uint32_t baudrate);
+
 typedef enum TFMINI_PLUS_OUTPUT_FORMAT {
     TFMINI_PLUS_OUTPUT_CM = 1,
     TFMINI_PLUS_OUTPUT_PIXHAWK = 2,
     TFMINI_PLUS_OUTPUT_MM = 6
 } tfminiplus_output_format_t;
 
+typedef enum TFMINI_PLUS_READ_MODE {
+    TFMINI_PLUS_READ_FIRST = 0,
+    TFMINI_PLUS_READ_LATEST = 1,
+} tfminiplus_read_mode_t;
+
 typedef enum TFMINI_PLUS_COMMUNICATION_MODE {
     TFMINI_PLUS_UART = 0,
     TFMINI_PLUS_I2C = 1,
 } tfminiplus_communication_mode_t;
 
+typedef enum TFMINI_PLUS_FRAME_TYPE {
+    TFMINI_PLUS_FRAME_NONE = 0,
+    TFMINI_PLUS_FRAME_DATA = 1,
+    TFMINI_PLUS_FRAME_RESPONSE = 2,
+} tfminiplus_frame_type_t;
+
+typedef enum TFMINI_PLUS_UART_POLICY {
+    TFMINI_PLUS_UART_DRAIN_AND_FLUSH = 0,  // Drop waiting RX data and wait for TX to finish before each send
+    TFMINI_PLUS_UART_DRAIN = 1,            // Drop waiting RX data before each send
+    TFMINI_PLUS_UART_ORDERED = 2,          // Keep RX data; frames around a command are tagged instead
+} tfminiplus_uart_policy_t;
+
+typedef enum TFMINI_PLUS_DATA_FLAGS {
+    TFMINI_PLUS_DATA_BEFORE_COMMAND = 0x01,  // Frame had already arrived when a command was sent
+    TFMINI_PLUS_DATA_DURING_COMMAND = 0x02,  // Frame arrived after a command was sent, before its response or timeout
+    TFMINI_PLUS_DATA_PIXHAWK = 0x04,         // Frame was decoded from Pixhawk text; strength and temperature are placeholders
+} tfminiplus_data_flags_t;
+
+typedef enum TFMINI_PLUS_RECOVERY_LEVEL {
+    TFMINI_PLUS_RECOVERY_NONE = 0,            // Link is healthy
+    TFMINI_PLUS_RECOVERY_DRAIN = 1,           // Waiting data was dropped to resynchronise
+    TFMINI_PLUS_RECOVERY_RESTART_OUTPUT = 2,  // Data output was disabled and enabled again
+    TFMINI_PLUS_RECOVERY_RESET = 3,           // The lidar was reset
+    TFMINI_PLUS_RECOVERY_BAUDRATE = 4,        // The lidar's baudrate was searched for and renegotiated
+} tfminiplus_recovery_level_t;
+
+typedef enum TFMINI_PLUS_SETTING {
+    TFMINI_PLUS_SETTING_FRAMERATE = 0x01,
+    TFMINI_PLUS_SETTING_BAUDRATE = 0x02,
+    TFMINI_PLUS_SETTING_OUTPUT_FORMAT = 0x04,
+    TFMINI_PLUS_SETTING_OUTPUT_ENABLED = 0x08,
+    TFMINI_PLUS_SETTING_ALL = 0x0F,
+} tfminiplus_setting_t;
+
+/**
+ * Lidar settings that can be written with configure().
+ * The driver also keeps a copy of what it has written to the lidar, so unchanged settings are not sent again.
+ */
+typedef struct {
+    tfminiplus_framerate_t framerate;
+    tfminiplus_baudrate_t baudrate;
+    tfminiplus_output_format_t output_format;
+    bool output_enabled;
+} tfminiplus_settings_t;
+
+typedef enum TFMINI_PLUS_EVENT {
+    TFMINI_PLUS_EVENT_NEAR = 0,    // Distance dropped below the critical distance
+    TFMINI_PLUS_EVENT_FAR = 1,     // Distance rose above the critical distance plus hysteresis
+    TFMINI_PLUS_EVENT_CHANGE = 2,  // Distance moved further than the deadband from the last reported value
+} tfminiplus_event_t;
+
+typedef enum TFMINI_PLUS_PARSE_STATUS {
+    TFMINI_PLUS_PARSE_OK = 0,              // Byte was added to a frame, or completed one
+    TFMINI_PLUS_PARSE_DISCARDED = 1,       // Byte was not part of any frame
+    TFMINI_PLUS_PARSE_RESYNC = 2,          // A partial frame was dropped because the byte did not fit it
+    TFMINI_PLUS_PARSE_CHECKSUM_ERROR = 3,  // A complete frame failed its checksum
+} tfminiplus_parse_status_t;
+
+/**
+ * Driver health counters. Compiled out when TFMINI_PLUS_DISABLE_STATS is defined.
+ * Call times are in microseconds and cover each call to poll() and read_data() while
+ * set_call_timing() is enabled; otherwise they stay at zero.
+ */
+typedef struct {
+    uint32_t frames_ok;
+    uint32_t checksum_errors;
+    uint32_t resyncs;
+    uint32_t bytes_discarded;
+    uint32_t timeouts;
+    uint32_t invalid_frames;
+    uint32_t ring_overflows;
+    uint32_t calls;
+    uint32_t min_call_time;
+    uint32_t max_call_time;
+    uint32_t average_call_time;
+    uint32_t total_call_time;
+} tfminiplus_stats_t;
+
+#ifndef TFMINI_PLUS_DISABLE_STATS
+#define TFMINI_PLUS_COUNT(counter) (_stats.counter++)
+#define TFMINI_PLUS_COUNT_BY(counter, amount) (_stats.counter += (amount))
+#else
+#define TFMINI_PLUS_COUNT(counter) ((void)0)
+#define TFMINI_PLUS_COUNT_BY(counter, amount) ((void)0)
+#endif
+
+/**
+ * Completion callback for queued commands.
+ * The response is only valid for the duration of the callback; it is null if the command failed or expects no response.
+ */
+typedef void (*tfminiplus_command_callback_t)(tfminiplus_command_t command, bool success, const uint8_t *response, uint8_t size, void *context);
+
+/**
+ * Called for each valid data frame found by parse_buffer().
+ *
+ * @param data: Decoded measurement; only valid for the duration of the call.
+ * @param context: Pointer given to parse_buffer().
+ */
+typedef void (*tfminiplus_frame_callback_t)(const tfminiplus_data_t &data, void *context);
+
+/**
+ * Called from the read path when a distance event occurs; see set_threshold_event() and set_change_event().
+ *
+ * @param event: Event that occurred.
+ * @param data: Frame that caused the event.
+ * @param context: Pointer given when the event was set.
+ */
+typedef void (*tfminiplus_event_callback_t)(tfminiplus_event_t event, const tfminiplus_data_t &data, void *context);
+
+typedef struct {
+    uint8_t packet[TFMINI_PLUS_MAXIMUM_PACKET_SIZE];
+    uint8_t response_size;
+    tfminiplus_command_callback_t callback;
+    void *context;
+} tfminiplus_queued_command_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Complete command packet, including header and checksum.
+ * Built by the tfminiplus_make_packet functions, which can be evaluated at compile time.
+ */
+template <uint8_t N>
+struct tfminiplus_packet_t {
+    uint8_t data[N];
+};
+
+/**
+ * Build a command packet that takes no arguments.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @return: Packet with the checksum filled in.
+ */
+constexpr tfminiplus_packet_t<4> tfminiplus_make_packet(tfminiplus_command_t command) {
+    return {{TFMINI_PLUS_FRAME_START, 4, uint8_t(command), uint8_t(TFMINI_PLUS_FRAME_START + 4 + command)}};
+}
+
+/**
+ * Build a command packet with a one-byte argument.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @param value: Argument value.
+ * @return: Packet with the checksum filled in.
+ */
+constexpr tfminiplus_packet_t<5> tfminiplus_make_packet_u8(tfminiplus_command_t command, uint8_t value) {
+    return {{TFMINI_PLUS_FRAME_START, 5, uint8_t(command), value, uint8_t(TFMINI_PLUS_FRAME_START + 5 + command + value)}};
+}
+
+/**
+ * Build a command packet with a two-byte argument, sent little-endian.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @param value: Argument value.
+ * @return: Packet with the checksum filled in.
+ */
+constexpr tfminiplus_packet_t<6> tfminiplus_make_packet_u16(tfminiplus_command_t command, uint16_t value) {
+    return {{TFMINI_PLUS_FRAME_START, 6, uint8_t(command), uint8_t(value), uint8_t(value >> 8),
+             uint8_t(TFMINI_PLUS_FRAME_START + 6 + command + uint8_t(value) + uint8_t(value >> 8))}};
+}
+
+/**
+ * Build a command packet with a four-byte argument, sent little-endian.
+ *
+ * @param command: 8-bit command; see TFMINI_PLUS_COMMANDS.
+ * @param value: Argument value.
+ * @return: Packet with the checksum filled in.
+ */
+constexpr tfminiplus_packet_t<8> tfminiplus_make_packet_u32(tfminiplus_command_t command, uint32_t value) {
+    return {{TFMINI_PLUS_FRAME_START, 8, uint8_t(command), uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24),
+             uint8_t(TFMINI_PLUS_FRAME_START + 8 + command + uint8_t(value) + uint8_t(value >> 8) + uint8_t(value >> 16) + uint8_t(value >> 24))}};
+}
+
+// Fixed commands, precomputed with their checksums
+constexpr tfminiplus_packet_t<4> TFMINI_PLUS_PACKET_GET_VERSION = tfminiplus_make_packet(TFMINI_PLUS_GET_VERSION);
+constexpr tfminiplus_packet_t<4> TFMINI_PLUS_PACKET_SYSTEM_RESET = tfminiplus_make_packet(TFMINI_PLUS_SYSTEM_RESET);
+constexpr tfminiplus_packet_t<4> TFMINI_PLUS_PACKET_TRIGGER_DETECTION = tfminiplus_make_packet(TFMINI_PLUS_TRIGGER_DETECTION);
+constexpr tfminiplus_packet_t<4> TFMINI_PLUS_PACKET_RESTORE_FACTORY_SETTINGS = tfminiplus_make_packet(TFMINI_PLUS_RESTORE_FACTORY_SETTINGS);
+constexpr tfminiplus_packet_t<4> TFMINI_PLUS_PACKET_SAVE_SETTINGS = tfminiplus_make_packet(TFMINI_PLUS_SAVE_SETTINGS);
+constexpr tfminiplus_packet_t<5> TFMINI_PLUS_PACKET_GET_DATA_CM = tfminiplus_make_packet_u8(TFMINI_PLUS_GET_DATA, TFMINI_PLUS_OUTPUT_CM);
+constexpr tfminiplus_packet_t<5> TFMINI_PLUS_PACKET_GET_DATA_MM = tfminiplus_make_packet_u8(TFMINI_PLUS_GET_DATA, TFMINI_PLUS_OUTPUT_MM);
+
+// Protocol rules shared by TFminiPlus and TFminiPlusT
+void tfminiplus_build_packet(uint8_t *packet, tfminiplus_command_t command, const uint8_t *arguments, uint8_t size);
+uint8_t tfminiplus_calculate_checksum(const uint8_t *data, uint8_t size);
+bool tfminiplus_compare_checksum(const uint8_t *data, uint8_t size);
+bool tfminiplus_is_response_for(const uint8_t *response, uint8_t size, tfminiplus_command_t command);
+unsigned long tfminiplus_get_response_timeout(tfminiplus_command_t command);
+
+/**
+ * Get how far a frame's sample time lies before its arrival.
+ * The lidar integrates over a whole frame period and sends the result at its end.
+ *
+ * @param framerate: Framerate of the lidar in Hz, or 0 if frames are only sent on request.
+ * @return: Half a frame period in us.
+ */
+inline uint32_t tfminiplus_get_sample_offset(uint16_t framerate) { return framerate > 0 ? 500000UL / framerate : 0; }
+
+/**
+ * Typical response latency of each command, learned from the responses seen so far.
+ * Used to start polling for an I2C response shortly before it is due, instead of waiting out the worst case.
+ */
+class TFminiPlusLatency {
+   public:
+    void reset();
+    uint8_t get_typical(tfminiplus_command_t command) const;
+    unsigned long get_first_poll_delay(tfminiplus_command_t command) const;
+    void record(tfminiplus_command_t command, unsigned long latency);
+    void record_response(tfminiplus_command_t command, unsigned long latency, bool first_attempt);
+
+   private:
+    uint8_t _typical[TFMINI_PLUS_LATENCY_SLOTS];
+
+    static uint8_t get_slot(tfminiplus_command_t command);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Read-only view of a raw 9-byte data frame.
+ * Fields are decoded on access straight from the frame bytes, so nothing is copied and
+ * the temperature conversion only happens when get_temperature() is called.
+ */
+class TFminiPlusFrame {
+   public:
+    TFminiPlusFrame(const uint8_t *frame = 0) : _frame(frame) {}
+
+    uint16_t get_distance() const { return _frame[2] | (_frame[3] << 8); }
+    uint16_t get_strength() const { return _frame[4] | (_frame[5] << 8); }
+    uint16_t get_raw_temperature() const { return _frame[6] | (_frame[7] << 8); }
+    tfminiplus_temperature_t get_temperature() const { return tfminiplus_convert_temperature(get_raw_temperature()); }
+    const uint8_t *get_raw() const { return _frame; }
+
+    /**
+     * Check that the measurements are within their valid ranges.
+     * The temperature limit of 100 C is compared in raw units ((100 + 256) * 8) to avoid float maths.
+     */
+    bool is_valid() const {
+        uint16_t strength = get_strength();
+        return get_distance() > 0 and strength > 0 and strength != 65535 and get_raw_temperature() < TFMINI_PLUS_RAW_TEMPERATURE_LIMIT;
+    }
+
+   private:
+    const uint8_t *_frame;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Incremental parser for UART data frames and command responses.
+ * Bytes are fed in one at a time, so parsing can be resumed across calls without blocking.
+ * With the Pixhawk format selected, text lines of distance in metres are also decoded, and
+ * are returned as binary data frames so the rest of the driver handles both formats the same way.
+ */
+class TFminiPlusParser {
+   public:
+    TFminiPlusParser();
+    void reset();
+    const uint8_t *get_frame();
+    uint8_t get_frame_length();
+    void set_output_format(tfminiplus_output_format_t format);
+    bool is_text_frame();
+
+    /**
+     * Feed a single byte into the frame parser.
+     * Bytes in the middle of a frame are only stored and summed, so they are handled inline;
+     * headers, lengths, and checksums go through parse_boundary().
+     *
+     * @param c: Next byte from the lidar.
+     * @return: Type of frame completed by the byte, or TFMINI_PLUS_FRAME_NONE if the frame is incomplete or corrupt.
+     */
+    tfminiplus_frame_type_t parse(uint8_t c) {
+        if (_index < 2 or _index >= _length - 1) return parse_boundary(c);
+
+        _frame[_index++] = c;
+        _checksum += c;
+        _status = TFMINI_PLUS_PARSE_OK;
+        return TFMINI_PLUS_FRAME_NONE;
+    }
+
+    /**
+     * Get the number of bytes of the current frame received so far.
+     * This is 1 straight after a frame header byte has been accepted.
+     *
+     * @return: Number of bytes held for the frame in progress.
+     */
+    uint8_t get_received_count() const { return _index ? _index : _text_length; }
+
+    /**
+     * Get what happened to the last byte fed to the parser.
+     *
+     * @return: Status of the last parsed byte.
+     */
+    tfminiplus_parse_status_t get_status() const { return _status; }
+
+    /**
+     * Get the number of bytes left before the checksum of the frame in progress.
+     * These bytes can neither finish nor break the frame.
+     *
+     * @return: Number of body bytes still to come, or 0 outside a frame body.
+     */
+    uint8_t get_body_remaining() const { return (_index >= 2 and _index < _length - 1) ? _length - 1 - _index : 0; }
+
+   private:
+    uint8_t _frame[TFMINI_PLUS_MAXIMUM_PACKET_SIZE];
+    uint8_t _index;
+    uint8_t _length;
+    uint8_t _checksum;
+    tfminiplus_parse_status_t _status;
+
+    bool _text_format;
+    bool _text_frame;
+    uint8_t _text_length;
+    int8_t _text_decimals;
+    uint32_t _text_value;
+
+    tfminiplus_frame_type_t parse_boundary(uint8_t c);
+
+#if TFMINI_PLUS_HAS_EXTRAS
+    tfminiplus_frame_type_t parse_text(uint8_t c);
+    void build_text_frame(uint16_t distance);
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+class TFminiPlusFilter;
+
 class TFminiPlus {
    public:
-    void begin(uint8_t address = 0x10);
+    void begin(uint8_t address = 0x10, TwoWire *bus = &Wire);
     void begin(Stream *stream);
 
+#if TFMINI_PLUS_HAS_EXTRAS
     bool set_communication_interface(tfminiplus_communication_mode_t mode);
     bool set_i2c_address(uint8_t address);
+    bool factory_reset();
+    bool negotiate_baudrate(tfminiplus_baudrate_t baudrate, tfminiplus_baudrate_t current_baudrate, tfminiplus_baudrate_callback_t host_baudrate_callback);
+    bool set_io_mode(tfminiplus_mode_t mode, uint16_t critical_distance = 0, uint16_t hysteresis = 0);
+#endif
 
+#if TFMINI_PLUS_HAS_CONFIG
     bool save_settings();
     bool reset_system();
-    bool factory_reset();
     tfminiplus_version_t get_version();
+    bool read_version(tfminiplus_version_t &version);
 
     bool enable_output(bool output_enabled);
     bool set_framerate(tfminiplus_framerate_t framerate);
     bool set_baudrate(tfminiplus_baudrate_t baudrate);
     bool set_output_format(tfminiplus_output_format_t format);
-    bool set_io_mode(tfminiplus_mode_t mode, uint16_t critical_distance = 0, uint16_t hysteresis = 0);
+
+    bool configure(const tfminiplus_settings_t &settings, uint8_t fields = TFMINI_PLUS_SETTING_ALL);
+    bool queue_configuration(const tfminiplus_settings_t &settings, uint8_t fields = TFMINI_PLUS_SETTING_ALL);
+    bool is_configuring();
+    bool get_configuration_result();
+#endif
+    void set_host_baudrate(uint32_t baudrate);
+    void expect_output_format(tfminiplus_output_format_t format);
+    void assume_settings(const tfminiplus_settings_t &settings, uint8_t fields = TFMINI_PLUS_SETTING_ALL);
+    tfminiplus_settings_t get_settings();
+    uint8_t get_known_settings();
+    void forget_settings();
 
     void trigger_manual_reading();
     bool read_manual_reading(tfminiplus_data_t &data);
     tfminiplus_data_t get_manual_reading();
     uint16_t get_manual_distance();
 
+    void attach_ring_buffer(uint8_t *buffer, uint8_t size);
+    bool push_byte(uint8_t c);
+    void ingest();
+    size_t parse_buffer(const uint8_t *buffer, size_t size, tfminiplus_frame_callback_t callback = 0, void *context = 0);
+
+    void set_read_mode(tfminiplus_read_mode_t mode);
+    uint16_t get_frames_skipped();
+
+    bool poll(tfminiplus_data_t &data);
+    bool poll_frame(TFminiPlusFrame &frame);
+    size_t read_frames(tfminiplus_data_t *output, size_t max_frames);
+    size_t read_frames(uint16_t *distances, uint16_t *strengths, size_t max_frames);
     bool read_data(tfminiplus_data_t &data, bool in_mm_format = true);
+    bool request_data(bool in_mm_format = true);
+    bool collect_data(tfminiplus_data_t &data);
+    void set_pipelined(bool enabled);
+    void set_filter(TFminiPlusFilter *filter);
+    void set_uart_policy(tfminiplus_uart_policy_t policy);
+
+    tfminiplus_stats_t get_stats();
+    void reset_stats();
+    void set_call_timing(bool enabled);
+
+#if TFMINI_PLUS_HAS_EXTRAS
+    void set_threshold_event(uint16_t critical_distance, uint16_t hysteresis, tfminiplus_event_callback_t callback, void *context = 0);
+    void set_change_event(uint16_t deadband, tfminiplus_event_callback_t callback, void *context = 0);
+
+    void set_recovery(bool enabled, uint8_t error_percent = TFMINI_PLUS_RECOVERY_ERROR_PERCENT, tfminiplus_baudrate_callback_t host_baudrate_callback = 0);
+    bool supervise();
+    tfminiplus_recovery_level_t get_recovery_level();
+#endif
+
+    bool get_latest(tfminiplus_data_t &data);
+    uint32_t get_latest_count();
+
+#if defined(ESP32)
+    bool start_task(bool in_mm_format = true, BaseType_t core = tskNO_AFFINITY, UBaseType_t priority = 1, uint32_t stack_size = 2048);
+    void stop_task();
+#endif
     tfminiplus_data_t get_data(bool in_mm_format = true);
     uint16_t get_distance(bool in_mm_format = true);
 
+#if TFMINI_PLUS_HAS_EXTRAS
     float get_effective_accuracy(uint16_t strength, uint16_t frequency);
+    float get_effective_accuracy(uint16_t strength);
+    int16_t get_effective_accuracy_fixed(uint16_t strength, uint16_t frequency);
+    int16_t get_effective_accuracy_fixed(uint16_t strength);
+#endif
+
+#if TFMINI_PLUS_HAS_CONFIG
+    bool queue_command(tfminiplus_command_t command, uint8_t *arguments, uint8_t size, tfminiplus_command_callback_t callback = 0,
+                       void *context = 0);
+    bool queue_command(tfminiplus_command_t command, tfminiplus_command_callback_t callback = 0, void *context = 0);
+    void service();
+    uint8_t get_queued_commands();
+#endif
 
     void dump_serial_cache();
+    TwoWire *get_bus();
 
    private:
     uint8_t _address;
+    TwoWire *_bus;
     uint8_t _communications_mode;
     Stream *_stream;
+    TFminiPlusParser _parser;
+    uint8_t _read_mode;
+
+    uint8_t *_ring_buffer;
+    uint8_t _ring_mask;
+    volatile uint8_t _ring_head;
+    volatile uint8_t _ring_tail;
+    uint16_t _frames_skipped;
+    uint8_t _stashed_frame[TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE];
+    bool _frame_stashed;
+    uint8_t _latest_frame[TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE];
+
+#if TFMINI_PLUS_HAS_CONFIG
+    tfminiplus_queued_command_t _command_queue[TFMINI_PLUS_COMMAND_QUEUE_SIZE];
+    uint8_t _queue_head;
+    uint8_t _queue_count;
+    bool _command_in_flight;
+    unsigned long _command_sent_time;
+    unsigned long _poll_delay;
+    uint8_t _poll_interval;
+#endif
+    TFminiPlusLatency _latency;
+    unsigned long _last_send_time;
+
+    bool _pipelined;
+    bool _data_requested;
+    bool _requested_mm_format;
+    unsigned long _data_poll_delay;
+    uint8_t _data_poll_interval;
+
+    TFminiPlusFilter *_filter;
+
+    tfminiplus_settings_t _settings;
+    uint8_t _settings_known;
+    tfminiplus_version_t _version;
+    bool _version_known;
+#if TFMINI_PLUS_HAS_CONFIG
+    uint8_t _configuration_pending;
+    bool _configuration_ok;
+#endif
+
+    uint16_t _framerate;
+    uint32_t _sample_offset;
+    uint32_t _host_baudrate;
+    uint16_t _byte_time;
+    uint32_t _header_time;
+    uint32_t _frame_time;
+    uint32_t _stashed_frame_time;
+    volatile uint32_t _last_push_time;
+    uint32_t _block_time;
+    size_t _block_remaining;
+    bool _block_timed;
+    bool _scanning_block;
+
+#if TFMINI_PLUS_HAS_EXTRAS
+    tfminiplus_event_callback_t _threshold_callback;
+    void *_threshold_context;
+    uint16_t _critical_distance;
+    uint16_t _hysteresis;
+    uint8_t _zone;
+    tfminiplus_event_callback_t _change_callback;
+    void *_change_context;
+    uint16_t _deadband;
+    uint16_t _reported_distance;
+    bool _change_primed;
+
+    bool _recovery_enabled;
+    uint8_t _recovery_error_percent;
+    tfminiplus_baudrate_callback_t _recovery_host_baudrate_callback;
+    uint32_t _recovery_baudrate;
+    tfminiplus_recovery_level_t _recovery_level;
+    unsigned long _recovery_window_start;
+    unsigned long _recovery_wait;
+    uint32_t _health_frames;
+    uint32_t _health_errors;
+    uint32_t _health_discarded;
+#endif
+
+    tfminiplus_data_t _latest_data;
+    volatile uint32_t _latest_sequence;
+
+#if defined(ESP32)
+    TaskHandle_t _task;
+    volatile bool _task_stopping;
+    bool _task_mm_format;
+
+    static void run_task(void *parameter);
+#endif
+
+    tfminiplus_uart_policy_t _uart_policy;
+    int _bytes_before_command;
+    bool _awaiting_response;
+    uint8_t _frame_flags;
+    uint8_t _stashed_frame_flags;
+
+#ifndef TFMINI_PLUS_DISABLE_STATS
+    tfminiplus_stats_t _stats;
+    bool _call_timing;
+#endif
 
-    void do_i2c_wait();
+    void initialise();
 
-    bool send(uint8_t *input, uint8_t size);
-    bool send_uart(uint8_t *input, uint8_t size);
-    bool send_i2c(uint8_t *input, uint8_t size);
+    bool send(const uint8_t *input, uint8_t size);
+    bool send_uart(const uint8_t *input, uint8_t size);
+    bool send_i2c(const uint8_t *input, uint8_t size);
+    template <uint8_t N>
+    bool send_packet(const tfminiplus_packet_t<N> &packet) {
+        return send(packet.data, N);
+    }
     bool send_command(tfminiplus_command_t command, uint8_t *arguments, uint8_t size);
     bool send_command(tfminiplus_command_t command);
 
+#if TFMINI_PLUS_HAS_CONFIG
+    uint8_t get_response_length(tfminiplus_command_t command);
+    bool validate_response(const uint8_t *packet, const uint8_t *response, uint8_t size);
+    void handle_response(const uint8_t *response, uint8_t size);
+    void finish_command(bool success, const uint8_t *response, uint8_t size);
+#endif
+
+    int bytes_available();
+    int read_byte();
+    tfminiplus_frame_type_t parse_byte(uint8_t c);
+    tfminiplus_frame_type_t parse_block_byte();
+    bool take_stashed_frame(TFminiPlusFrame &frame);
+    void stash_frame();
+    uint32_t get_header_arrival_time();
+    void start_block();
+    void remember_framerate(uint16_t framerate);
+    void record_parse_status();
+    uint32_t get_call_start_time();
+    void record_call_time(uint32_t start_time);
+    void publish_latest(const tfminiplus_data_t &data);
+#if TFMINI_PLUS_HAS_EXTRAS
+    void evaluate_events(const tfminiplus_data_t &data);
+    bool is_link_healthy();
+    void reset_health();
+    void run_recovery_step(tfminiplus_recovery_level_t level);
+    bool recover_baudrate();
+#endif
+
     bool receive(uint8_t *output, uint8_t size);
-    uint8_t receive_uart(uint8_t *output, uint8_t size, unsigned long timeout = 10);
+    uint8_t receive_uart(uint8_t *output, uint8_t size, unsigned long timeout = TFMINI_PLUS_DATA_TIMEOUT);
+    uint8_t receive_uart_ordered(uint8_t *output, uint8_t size, unsigned long timeout);
+    void drain_receive_buffer();
     uint8_t receive_i2c(uint8_t *output, uint8_t size);
-    bool uart_receive_data(uint8_t *output, uint8_t size, unsigned long timeout = 10);
+    bool receive_response(uint8_t *output, uint8_t size, tfminiplus_command_t command);
+    bool uart_receive_data(uint8_t *output, uint8_t size, unsigned long timeout = TFMINI_PLUS_DATA_TIMEOUT);
+    bool uart_receive_frame(TFminiPlusFrame &frame);
+    bool uart_receive_next_frame(TFminiPlusFrame &frame);
+    bool uart_receive_latest_frame(TFminiPlusFrame &frame);
     bool read_data_response(tfminiplus_data_t &data);
+    bool parse_data_frame(const uint8_t *frame, tfminiplus_data_t &data);
 
-    uint8_t calculate_checksum(uint8_t *data, uint8_t size);
-    bool compare_checksum(uint8_t *data, uint8_t size);
+#if TFMINI_PLUS_HAS_EXTRAS
+    int32_t calculate_log10_fixed(uint16_t value);
+    bool switch_host_baudrate(uint32_t baudrate, tfminiplus_baudrate_callback_t host_baudrate_callback);
+#endif
+
+#if TFMINI_PLUS_HAS_CONFIG
+    uint8_t build_configuration(const tfminiplus_settings_t &settings, uint8_t fields, uint8_t packets[][TFMINI_PLUS_MAXIMUM_PACKET_SIZE]);
+    void remember_setting(const uint8_t *packet);
+    uint8_t get_setting_field(tfminiplus_command_t command);
+    static void handle_configuration_response(tfminiplus_command_t command, bool success, const uint8_t *response, uint8_t size, void *context);
+#endif
 };
 
 #endif
@@ -0,0 +1,371 @@
+#include <TFmini_plus_array.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+TFminiPlusArray::TFminiPlusArray() : _count(0) {
+#if defined(ESP32)
+    // Set once here rather than in begin(), so beginning again does not lose a running task or leak its lock
+    _task = 0;
+    _results_lock = 0;
+#endif
+}
+
+/**
+ * Start communication with a set of lidars on one I2C bus.
+ *
+ * @param addresses: I2C addresses of the lidars. Each must be unique on the bus.
+ * @param count: Number of lidars. Limited to TFMINI_PLUS_ARRAY_MAX_SENSORS.
+ * @param bus: I2C bus the lidars are connected to. Defaults to &Wire.
+ * @return: True if every lidar could be added.
+ */
+bool TFminiPlusArray::begin(const uint8_t *addresses, uint8_t count, TwoWire *bus) {
+    bool result = initialise(count);
+    for (uint8_t i = 0; i < _count; i++) _sensors[i].begin(addresses[i], bus);
+    return result;
+}
+
+/**
+ * Start communication with a set of lidars spread across several I2C buses.
+ * The buses are still serviced one after another; use one array per bus with start_task() for concurrency.
+ *
+ * @param addresses: I2C addresses of the lidars. Each must be unique on its bus.
+ * @param buses: I2C bus of each lidar, in the same order as the addresses.
+ * @param count: Number of lidars. Limited to TFMINI_PLUS_ARRAY_MAX_SENSORS.
+ * @return: True if every lidar could be added.
+ */
+bool TFminiPlusArray::begin(const uint8_t *addresses, TwoWire *const *buses, uint8_t count) {
+    bool result = initialise(count);
+    for (uint8_t i = 0; i < _count; i++) _sensors[i].begin(addresses[i], buses[i]);
+    return result;
+}
+
+/**
+ * Put the array into its starting state, with no results and no cycle in progress.
+ *
+ * @param count: Number of lidars. Limited to TFMINI_PLUS_ARRAY_MAX_SENSORS.
+ * @return: True if every lidar fits in the array.
+ */
+bool TFminiPlusArray::initialise(uint8_t count) {
+    bool result = count <= TFMINI_PLUS_ARRAY_MAX_SENSORS;
+    _count = result ? count : TFMINI_PLUS_ARRAY_MAX_SENSORS;
+
+    for (uint8_t i = 0; i < _count; i++) {
+        _valid[i] = false;
+        _pending[i] = false;
+    }
+
+    _phase = TFMINI_PLUS_ARRAY_REQUEST;
+    _cycles = 0;
+    return result;
+}
+
+/**
+ * Progress the acquisition cycle without blocking.
+ * Call this regularly from the main loop.
+ *
+ * @param in_mm_format: True to request the data frames in mm units.
+ * @return: True if a cycle has just completed and a fresh set of results is available.
+ */
+bool TFminiPlusArray::update(bool in_mm_format) {
+    bool cycle_complete = false;
+
+    if (_phase == TFMINI_PLUS_ARRAY_REQUEST) {
+        request_all(in_mm_format);
+        _phase = TFMINI_PLUS_ARRAY_COLLECT;
+
+    } else if (collect_all() or (millis() - _cycle_start) >= TFMINI_PLUS_RESPONSE_TIMEOUT) {
+        // Sensors that never answered keep their last reading but are flagged invalid
+        for (uint8_t i = 0; i < _count; i++) {
+            if (_pending[i]) _valid[i] = false;
+            _pending[i] = false;
+        }
+
+        _cycles++;
+        _phase = TFMINI_PLUS_ARRAY_REQUEST;
+        cycle_complete = true;
+    }
+
+    return cycle_complete;
+}
+
+/**
+ * Run one complete acquisition cycle, blocking until it is done.
+ *
+ * @param in_mm_format: True to request the data frames in mm units.
+ * @return: True if every lidar returned a valid frame.
+ */
+bool TFminiPlusArray::read_all(bool in_mm_format) {
+    _phase = TFMINI_PLUS_ARRAY_REQUEST;
+    while (not update(in_mm_format)) {
+    }
+
+    bool result = true;
+    for (uint8_t i = 0; i < _count; i++) result &= _valid[i];
+    return result;
+}
+
+/**
+ * Trigger a manual reading on every lidar as close together as possible.
+ * Intended for lidars running at 0 Hz, so that all sensors sample the same instant.
+ * Results are collected by the following update() calls, or use read_all_triggered() to block until done.
+ *
+ * @param use_general_call: True to trigger every lidar with a single I2C general call.
+ *                          Only use this if the lidar firmware responds to the general call address.
+ * @param in_mm_format: True to request the data frames in mm units.
+ * @return: True if every trigger was sent.
+ */
+bool TFminiPlusArray::trigger_all(bool use_general_call, bool in_mm_format) {
+    bool result = true;
+
+    if (use_general_call) {
+        unsigned long trigger_time = micros();
+        result = send_general_call_trigger();
+        for (uint8_t i = 0; i < _count; i++) _trigger_times[i] = trigger_time;
+
+    } else {
+        // Nothing else happens between triggers to keep the skew down to a single bus transaction
+        for (uint8_t i = 0; i < _count; i++) {
+            _trigger_times[i] = micros();
+            _sensors[i].trigger_manual_reading();
+        }
+    }
+
+    request_all(in_mm_format);
+    _phase = TFMINI_PLUS_ARRAY_COLLECT;
+    return result;
+}
+
+/**
+ * Trigger every lidar and block until all of the results have been collected.
+ *
+ * @param use_general_call: True to trigger every lidar with a single I2C general call.
+ * @param in_mm_format: True to request the data frames in mm units.
+ * @return: True if every lidar returned a valid frame.
+ */
+bool TFminiPlusArray::read_all_triggered(bool use_general_call, bool in_mm_format) {
+    bool result = trigger_all(use_general_call, in_mm_format);
+    while (not update(in_mm_format)) {
+    }
+
+    for (uint8_t i = 0; i < _count; i++) result &= _valid[i];
+    return result;
+}
+
+/**
+ * Get the time that a lidar was last triggered.
+ *
+ * @param index: Position of the lidar in the address list.
+ * @return: Time of the trigger in microseconds (from micros()).
+ */
+unsigned long TFminiPlusArray::get_trigger_time(uint8_t index) { return _trigger_times[index]; }
+
+#if TFMINI_PLUS_HAS_CONFIG
+/**
+ * Write and save the same settings on every lidar, blocking until all have finished.
+ * Each lidar only gets the settings it does not already have. The commands are queued on every lidar
+ * and serviced in turn, so the lidars process them at the same time rather than one after another.
+ *
+ * @param settings: Settings to write.
+ * @param fields: Settings to apply, from TFMINI_PLUS_SETTING.
+ * @return: True if every lidar accepted and saved its settings.
+ */
+bool TFminiPlusArray::configure_all(const tfminiplus_settings_t &settings, uint8_t fields) {
+    bool queued[TFMINI_PLUS_ARRAY_MAX_SENSORS];
+    for (uint8_t i = 0; i < _count; i++) queued[i] = _sensors[i].queue_configuration(settings, fields);
+
+    bool busy = true;
+    while (busy) {
+        busy = false;
+        for (uint8_t i = 0; i < _count; i++) {
+            _sensors[i].service();
+            busy |= _sensors[i].is_configuring();
+        }
+    }
+
+    bool result = true;
+    for (uint8_t i = 0; i < _count; i++) result &= queued[i] and _sensors[i].get_configuration_result();
+    return result;
+}
+#endif
+
+/**
+ * Send the trigger detection command to the I2C general call address of every bus in use.
+ *
+ * @return: True if every transmission was acknowledged.
+ */
+bool TFminiPlusArray::send_general_call_trigger() {
+    bool result = true;
+
+    for (uint8_t i = 0; i < _count; i++) {
+        TwoWire *bus = _sensors[i].get_bus();
+
+        // Each bus only needs one general call
+        bool bus_triggered = false;
+        for (uint8_t j = 0; j < i; j++) bus_triggered |= (_sensors[j].get_bus() == bus);
+        if (bus_triggered) continue;
+
+        bus->beginTransmission(TFMINI_PLUS_GENERAL_CALL_ADDRESS);
+        uint8_t bytes_sent = bus->write(TFMINI_PLUS_PACKET_TRIGGER_DETECTION.data, sizeof(TFMINI_PLUS_PACKET_TRIGGER_DETECTION.data));
+        uint8_t error = bus->endTransmission(true);
+        result &= (bytes_sent == sizeof(TFMINI_PLUS_PACKET_TRIGGER_DETECTION.data) and not error);
+    }
+
+    return result;
+}
+
+/**
+ * Send a data request to every lidar back-to-back.
+ *
+ * @param in_mm_format: True to request the data frames in mm units.
+ */
+void TFminiPlusArray::request_all(bool in_mm_format) {
+    for (uint8_t i = 0; i < _count; i++) {
+        _pending[i] = _sensors[i].request_data(in_mm_format);
+        if (not _pending[i]) _valid[i] = false;
+    }
+    _cycle_start = millis();
+}
+
+/**
+ * Collect whichever requested frames are ready.
+ *
+ * @return: True if no lidars are still outstanding.
+ */
+bool TFminiPlusArray::collect_all() {
+    bool all_collected = true;
+
+    for (uint8_t i = 0; i < _count; i++) {
+        if (not _pending[i]) continue;
+
+        tfminiplus_data_t data;
+        if (_sensors[i].collect_data(data)) {
+            _results[i] = data;
+            _valid[i] = true;
+            _pending[i] = false;
+        } else {
+            all_collected = false;
+        }
+    }
+
+    return all_collected;
+}
+
+/**
+ * Get the number of lidars managed by the array.
+ *
+ * @return: Number of lidars.
+ */
+uint8_t TFminiPlusArray::get_sensor_count() { return _count; }
+
+/**
+ * Get direct access to one of the lidars, eg. for configuration.
+ * Configuration should not be done while a cycle is in progress.
+ *
+ * @param index: Position of the lidar in the address list.
+ * @return: Driver for the lidar.
+ */
+TFminiPlus &TFminiPlusArray::get_sensor(uint8_t index) { return _sensors[index]; }
+
+/**
+ * Get the latest results from every lidar, in address-list order.
+ * Check is_valid() before using an entry.
+ *
+ * @return: Array of get_sensor_count() data frames.
+ */
+const tfminiplus_data_t *TFminiPlusArray::get_results() { return _results; }
+
+/**
+ * Check whether a lidar returned a valid frame in the last completed cycle.
+ *
+ * @param index: Position of the lidar in the address list.
+ * @return: True if the result for the lidar is valid.
+ */
+bool TFminiPlusArray::is_valid(uint8_t index) { return index < _count and _valid[index]; }
+
+/**
+ * Get the number of completed acquisition cycles.
+ *
+ * @return: Number of cycles since begin().
+ */
+unsigned long TFminiPlusArray::get_cycle_count() { return _cycles; }
+
+///////////////////////////////////////////////////////////////////////////////
+
+#if defined(ESP32)
+/**
+ * Run the acquisition cycle in a dedicated FreeRTOS task.
+ * Once started, update() must not be called directly; use copy_results() to read the latest batch.
+ *
+ * @param in_mm_format: True to request the data frames in mm units.
+ * @param core: Core to pin the task to, or tskNO_AFFINITY.
+ * @param priority: FreeRTOS priority of the task.
+ * @param stack_size: Stack size of the task in bytes.
+ * @return: True if the task was started.
+ */
+bool TFminiPlusArray::start_task(bool in_mm_format, BaseType_t core, UBaseType_t priority, uint32_t stack_size) {
+    if (_task) return false;
+    if (not _results_lock) _results_lock = xSemaphoreCreateMutex();
+    if (not _results_lock) return false;
+
+    _task_mm_format = in_mm_format;
+    _task_stopping = false;
+    return xTaskCreatePinnedToCore(run_task, "tfminiplus_array", stack_size, this, priority, &_task, core) == pdPASS;
+}
+
+/**
+ * Stop the acquisition task.
+ * The task finishes its current cycle first, so it never stops holding the bus or the results lock.
+ */
+void TFminiPlusArray::stop_task() {
+    if (not _task) return;
+    _task_stopping = true;
+    while (_task_stopping) vTaskDelay(1);
+    _task = 0;
+}
+
+/**
+ * Copy the latest completed batch published by the acquisition task.
+ * This does not wait; it fails if the task is publishing at that moment.
+ *
+ * @param output: Container for get_sensor_count() data frames.
+ * @param valid: Container for get_sensor_count() valid flags, or null.
+ * @return: True if the results were copied.
+ */
+bool TFminiPlusArray::copy_results(tfminiplus_data_t *output, bool *valid) {
+    if (not _results_lock or xSemaphoreTake(_results_lock, 0) != pdTRUE) return false;
+
+    memcpy(output, _published_results, _count * sizeof(tfminiplus_data_t));
+    if (valid) memcpy(valid, _published_valid, _count * sizeof(bool));
+
+    xSemaphoreGive(_results_lock);
+    return true;
+}
+
+/**
+ * Body of the acquisition task.
+ *
+ * @param parameter: Array that owns the task.
+ */
+void TFminiPlusArray::run_task(void *parameter) {
+    TFminiPlusArray *array = static_cast<TFminiPlusArray *>(parameter);
+
+    while (not array->_task_stopping) {
+        if (array->update(array->_task_mm_format)) array->publish_results();
+        vTaskDelay(1);
+    }
+
+    // Tell stop_task() the loop has finished before the task deletes itself
+    array->_task_stopping = false;
+    vTaskDelete(0);
+}
+
+/**
+ * Copy a completed batch to where copy_results() can read it.
+ */
+void TFminiPlusArray::publish_results() {
+    xSemaphoreTake(_results_lock, portMAX_DELAY);
+    memcpy(_published_results, _results, _count * sizeof(tfminiplus_data_t));
+    memcpy(_published_valid, _valid, _count * sizeof(bool));
+    xSemaphoreGive(_results_lock);
+}
+#endif
@@ -0,0 +1,101 @@
+#ifndef TF_MINI_PLUS_ARRAY_H
+#define TF_MINI_PLUS_ARRAY_H
+
+#include <TFmini_plus.h>
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Every slot holds a whole TFminiPlus, about 350 bytes of RAM on AVR with the full profile (230 with
+// TFMINI_PLUS_PROFILE_MINIMAL), whether or not it is used. Define this to match the number of lidars fitted.
+#ifndef TFMINI_PLUS_ARRAY_MAX_SENSORS
+#if defined(__AVR__)
+#define TFMINI_PLUS_ARRAY_MAX_SENSORS 4
+#else
+#define TFMINI_PLUS_ARRAY_MAX_SENSORS 12
+#endif
+#endif
+
+const uint8_t TFMINI_PLUS_GENERAL_CALL_ADDRESS = 0x00;
+
+typedef enum TFMINI_PLUS_ARRAY_PHASE {
+    TFMINI_PLUS_ARRAY_REQUEST = 0,
+    TFMINI_PLUS_ARRAY_COLLECT = 1,
+} tfminiplus_array_phase_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Scheduler for several lidars sharing an I2C bus.
+ * Each cycle requests a frame from every sensor back-to-back, then collects them all,
+ * so the sensors measure in parallel instead of one after another.
+ *
+ * Arrays do not share any state, so sensors split across buses (eg. Wire and Wire1) can be
+ * run as one array per bus. On ESP32, start_task() runs an array in its own FreeRTOS task so
+ * that the buses are driven concurrently.
+ */
+class TFminiPlusArray {
+   public:
+    TFminiPlusArray();
+    bool begin(const uint8_t *addresses, uint8_t count, TwoWire *bus = &Wire);
+    bool begin(const uint8_t *addresses, TwoWire *const *buses, uint8_t count);
+
+    bool update(bool in_mm_format = true);
+    bool read_all(bool in_mm_format = true);
+
+    bool trigger_all(bool use_general_call = false, bool in_mm_format = true);
+    bool read_all_triggered(bool use_general_call = false, bool in_mm_format = true);
+    unsigned long get_trigger_time(uint8_t index);
+
+#if TFMINI_PLUS_HAS_CONFIG
+    bool configure_all(const tfminiplus_settings_t &settings, uint8_t fields = TFMINI_PLUS_SETTING_ALL);
+#endif
+
+    uint8_t get_sensor_count();
+    TFminiPlus &get_sensor(uint8_t index);
+    const tfminiplus_data_t *get_results();
+    bool is_valid(uint8_t index);
+    unsigned long get_cycle_count();
+
+#if defined(ESP32)
+    bool start_task(bool in_mm_format = true, BaseType_t core = tskNO_AFFINITY, UBaseType_t priority = 1, uint32_t stack_size = 2048);
+    void stop_task();
+    bool copy_results(tfminiplus_data_t *output, bool *valid);
+#endif
+
+   private:
+    TFminiPlus _sensors[TFMINI_PLUS_ARRAY_MAX_SENSORS];
+    tfminiplus_data_t _results[TFMINI_PLUS_ARRAY_MAX_SENSORS];
+    bool _valid[TFMINI_PLUS_ARRAY_MAX_SENSORS];
+    bool _pending[TFMINI_PLUS_ARRAY_MAX_SENSORS];
+    unsigned long _trigger_times[TFMINI_PLUS_ARRAY_MAX_SENSORS];
+    uint8_t _count;
+
+    uint8_t _phase;
+    unsigned long _cycle_start;
+    unsigned long _cycles;
+
+    bool initialise(uint8_t count);
+    void request_all(bool in_mm_format);
+    bool collect_all();
+    bool send_general_call_trigger();
+
+#if defined(ESP32)
+    TaskHandle_t _task;
+    volatile bool _task_stopping;
+    SemaphoreHandle_t _results_lock;
+    bool _task_mm_format;
+    tfminiplus_data_t _published_results[TFMINI_PLUS_ARRAY_MAX_SENSORS];
+    bool _published_valid[TFMINI_PLUS_ARRAY_MAX_SENSORS];
+
+    static void run_task(void *parameter);
+    void publish_results();
+#endif
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include <TFmini_plus_esp32_uart.h>
+
+#if defined(ESP32)
+
+TFminiPlusEsp32Uart::TFminiPlusEsp32Uart(uart_port_t port) : _port(port), _installed(false), _peeked(-1) {}
+
+/**
+ * Install the ESP-IDF UART driver on the port.
+ *
+ * @param baudrate: Baudrate of the lidar.
+ * @param rx_pin: GPIO connected to the lidar's TX line.
+ * @param tx_pin: GPIO connected to the lidar's RX line.
+ * @param rx_buffer_size: Size of the driver's receive buffer in bytes. Must be larger than the hardware FIFO (128).
+ * @return: True if the driver was installed and configured.
+ */
+bool TFminiPlusEsp32Uart::begin(uint32_t baudrate, int rx_pin, int tx_pin, int rx_buffer_size) {
+    if (_installed) end();
+
+    uart_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.baud_rate = baudrate;
+    config.data_bits = UART_DATA_8_BITS;
+    config.parity = UART_PARITY_DISABLE;
+    config.stop_bits = UART_STOP_BITS_1;
+    config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+
+    bool result = uart_param_config(_port, &config) == ESP_OK;
+    result = result and uart_set_pin(_port, tx_pin, rx_pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) == ESP_OK;
+    result = result and uart_driver_install(_port, rx_buffer_size, 0, 0, 0, 0) == ESP_OK;
+
+    _installed = result;
+    _peeked = -1;
+    return result;
+}
+
+/**
+ * Remove the UART driver from the port.
+ */
+void TFminiPlusEsp32Uart::end() {
+    if (_installed) uart_driver_delete(_port);
+    _installed = false;
+    _peeked = -1;
+}
+
+/**
+ * Change the port's baudrate without reinstalling the driver.
+ *
+ * @param baudrate: New baudrate.
+ * @return: True if the baudrate was changed.
+ */
+bool TFminiPlusEsp32Uart::set_baudrate(uint32_t baudrate) { return _installed and uart_set_baudrate(_port, baudrate) == ESP_OK; }
+
+/**
+ * Hand everything the driver has received to the lidar's parser, one block at a time.
+ * Call from the loop, or from a task that owns the lidar.
+ *
+ * @param lidar: Lidar attached to this port.
+ * @param callback: Function called for each valid data frame, or null to keep only the newest
+ *      frame for the next poll() or read_data().
+ * @param context: Pointer passed through to the callback.
+ * @return: Number of valid data frames found.
+ */
+size_t TFminiPlusEsp32Uart::service(TFminiPlus &lidar, tfminiplus_frame_callback_t callback, void *context) {
+    size_t count = 0;
+    if (not _installed) return count;
+
+    if (_peeked >= 0) {
+        _block[0] = _peeked;
+        _peeked = -1;
+        count += lidar.parse_buffer(_block, 1, callback, context);
+    }
+
+    int bytes_read;
+    while ((bytes_read = uart_read_bytes(_port, _block, sizeof(_block), 0)) > 0) {
+        count += lidar.parse_buffer(_block, bytes_read, callback, context);
+    }
+    return count;
+}
+
+int TFminiPlusEsp32Uart::available() {
+    size_t waiting = 0;
+    if (_installed) uart_get_buffered_data_len(_port, &waiting);
+    return int(waiting) + (_peeked >= 0 ? 1 : 0);
+}
+
+int TFminiPlusEsp32Uart::read() {
+    int c = peek();
+    _peeked = -1;
+    return c;
+}
+
+int TFminiPlusEsp32Uart::peek() {
+    if (_peeked < 0 and _installed) {
+        uint8_t c;
+        if (uart_read_bytes(_port, &c, 1, 0) == 1) _peeked = c;
+    }
+    return _peeked;
+}
+
+size_t TFminiPlusEsp32Uart::write(uint8_t c) { return write(&c, 1); }
+
+size_t TFminiPlusEsp32Uart::write(const uint8_t *buffer, size_t size) {
+    if (not _installed) return 0;
+    int bytes_written = uart_write_bytes(_port, (const char *)buffer, size);
+    return bytes_written > 0 ? bytes_written : 0;
+}
+
+void TFminiPlusEsp32Uart::flush() {
+    if (_installed) uart_wait_tx_done(_port, portMAX_DELAY);
+}
+
+#endif
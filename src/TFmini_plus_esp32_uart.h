@@ -0,0 +1,58 @@
+#ifndef TF_MINI_PLUS_ESP32_UART_H
+#define TF_MINI_PLUS_ESP32_UART_H
+
+#include <TFmini_plus.h>
+
+#if defined(ESP32)
+#include <driver/uart.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TFMINI_PLUS_ESP32_RX_BUFFER_SIZE
+#define TFMINI_PLUS_ESP32_RX_BUFFER_SIZE 1024
+#endif
+
+#ifndef TFMINI_PLUS_ESP32_BLOCK_SIZE
+#define TFMINI_PLUS_ESP32_BLOCK_SIZE 128
+#endif
+
+/**
+ * UART port driven by the ESP-IDF UART driver instead of the Arduino HardwareSerial.
+ * The driver moves bytes from the hardware FIFO in bursts, so there is no per-byte interrupt or
+ * read call; service() then hands each burst to the lidar's parser as one block.
+ * The port is also a Stream, so it can be passed to TFminiPlus::begin() for sending commands.
+ * Do not use the same port through Serial1/Serial2 at the same time.
+ *
+ * Example:
+ *  TFminiPlusEsp32Uart port(UART_NUM_1);
+ *  port.begin(115200, 16, 17);
+ *  lidar.begin(&port);
+ *  ...
+ *  port.service(lidar, on_frame);
+ */
+class TFminiPlusEsp32Uart : public Stream {
+   public:
+    TFminiPlusEsp32Uart(uart_port_t port);
+
+    bool begin(uint32_t baudrate, int rx_pin, int tx_pin, int rx_buffer_size = TFMINI_PLUS_ESP32_RX_BUFFER_SIZE);
+    void end();
+    bool set_baudrate(uint32_t baudrate);
+
+    size_t service(TFminiPlus &lidar, tfminiplus_frame_callback_t callback = 0, void *context = 0);
+
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    void flush();
+
+   private:
+    uart_port_t _port;
+    bool _installed;
+    int _peeked;
+    uint8_t _block[TFMINI_PLUS_ESP32_BLOCK_SIZE];
+};
+
+#endif
+#endif
@@ -0,0 +1,163 @@
+#ifndef TF_MINI_PLUS_FILTER_H
+#define TF_MINI_PLUS_FILTER_H
+
+#include <TFmini_plus.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A stage in the driver's per-frame filter pipeline.
+ * Stages are chained with set_next() and run in order on every valid frame, while it is still hot
+ * from the parser. A stage rejecting a frame stops the chain and the read reports failure.
+ *
+ * Example:
+ *  TFminiPlusStrengthGate gate(200);
+ *  TFminiPlusMedianFilter<5> median;
+ *  gate.set_next(&median);
+ *  lidar.set_filter(&gate);
+ */
+class TFminiPlusFilter {
+   public:
+    TFminiPlusFilter() : _next(0) {}
+
+    /**
+     * Run this stage and every stage after it.
+     *
+     * @param data: Measurement to filter in place.
+     * @return: True if the measurement was accepted by all stages.
+     */
+    bool apply(tfminiplus_data_t &data) { return process(data) and (not _next or _next->apply(data)); }
+
+    /**
+     * Forget all filter history, including that of the following stages.
+     */
+    void reset_all() {
+        reset();
+        if (_next) _next->reset_all();
+    }
+
+    void set_next(TFminiPlusFilter *next) { _next = next; }
+    TFminiPlusFilter *get_next() const { return _next; }
+
+    virtual bool process(tfminiplus_data_t &data) = 0;
+    virtual void reset() {}
+
+   private:
+    TFminiPlusFilter *_next;
+};
+
+/**
+ * Running median of the last N distances.
+ * The window is kept sorted as samples arrive and expire, so each sample costs one binary search and
+ * a short shift rather than a full re-sort. For the small windows used on lidar data this beats a
+ * double heap in both code size and speed.
+ */
+template <uint8_t N>
+class TFminiPlusMedianFilter : public TFminiPlusFilter {
+   public:
+    TFminiPlusMedianFilter() { reset(); }
+
+    bool process(tfminiplus_data_t &data) {
+        if (_count < N) {
+            _window[_count++] = data.distance;
+        } else {
+            remove_sorted(_window[_oldest]);
+            _window[_oldest] = data.distance;
+            _oldest = (_oldest + 1) % N;
+        }
+        insert_sorted(data.distance);
+
+        data.distance = _sorted[(_sorted_count - 1) / 2];
+        return true;
+    }
+
+    void reset() {
+        _count = 0;
+        _sorted_count = 0;
+        _oldest = 0;
+    }
+
+   private:
+    uint16_t _window[N];
+    uint16_t _sorted[N];
+    uint8_t _count;
+    uint8_t _sorted_count;
+    uint8_t _oldest;
+
+    uint8_t lower_bound(uint16_t value) const {
+        uint8_t low = 0;
+        uint8_t high = _sorted_count;
+        while (low < high) {
+            uint8_t middle = (low + high) / 2;
+            if (_sorted[middle] < value) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    void insert_sorted(uint16_t value) {
+        uint8_t position = lower_bound(value);
+        for (uint8_t i = _sorted_count; i > position; i--) _sorted[i] = _sorted[i - 1];
+        _sorted[position] = value;
+        _sorted_count++;
+    }
+
+    void remove_sorted(uint16_t value) {
+        uint8_t position = lower_bound(value);
+        _sorted_count--;
+        for (uint8_t i = position; i < _sorted_count; i++) _sorted[i] = _sorted[i + 1];
+    }
+};
+
+/**
+ * Exponential moving average of the distance, with a smoothing factor of 1 / 2^SHIFT.
+ * The average is held with SHIFT extra fraction bits so small changes are not lost to rounding.
+ */
+template <uint8_t SHIFT>
+class TFminiPlusEmaFilter : public TFminiPlusFilter {
+   public:
+    TFminiPlusEmaFilter() { reset(); }
+
+    bool process(tfminiplus_data_t &data) {
+        if (not _primed) {
+            _average = uint32_t(data.distance) << SHIFT;
+            _primed = true;
+        } else {
+            _average = _average - (_average >> SHIFT) + data.distance;
+        }
+
+        data.distance = (_average + (1UL << SHIFT >> 1)) >> SHIFT;
+        return true;
+    }
+
+    void reset() {
+        _average = 0;
+        _primed = false;
+    }
+
+   private:
+    uint32_t _average;
+    bool _primed;
+};
+
+/**
+ * Reject frames whose signal strength is outside a trusted range.
+ * The lidar's own validity check only drops strengths of 0 and 65535; below about 100 the
+ * distance is unreliable and near saturation it may be a reflection.
+ */
+class TFminiPlusStrengthGate : public TFminiPlusFilter {
+   public:
+    TFminiPlusStrengthGate(uint16_t minimum_strength = 100, uint16_t maximum_strength = 65534)
+        : _minimum_strength(minimum_strength), _maximum_strength(maximum_strength) {}
+
+    bool process(tfminiplus_data_t &data) { return data.strength >= _minimum_strength and data.strength <= _maximum_strength; }
+
+   private:
+    uint16_t _minimum_strength;
+    uint16_t _maximum_strength;
+};
+
+#endif
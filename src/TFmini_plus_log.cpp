@@ -0,0 +1,201 @@
+#include <TFmini_plus_log.h>
+
+/**
+ * Encode a value as a little-endian base-128 varint.
+ *
+ * @param output: Container for at least 5 bytes.
+ * @param value: Value to encode.
+ * @return: Number of bytes written.
+ */
+static uint8_t write_varint(uint8_t *output, uint32_t value) {
+    uint8_t size = 0;
+    while (value >= 0x80) {
+        output[size++] = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    output[size++] = uint8_t(value);
+    return size;
+}
+
+/**
+ * Map a signed change onto an unsigned value so small negative changes stay short.
+ */
+static uint32_t zigzag_encode(int32_t value) { return (uint32_t(value) << 1) ^ uint32_t(value >> 31); }
+
+static int32_t zigzag_decode(uint32_t value) { return int32_t(value >> 1) ^ -int32_t(value & 1); }
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Writer for a log block in a caller-supplied buffer.
+ *
+ * @param buffer: Storage for the block.
+ * @param size: Size of the storage in bytes.
+ */
+TFminiPlusLogWriter::TFminiPlusLogWriter(uint8_t *buffer, size_t size) : _buffer(buffer), _capacity(size) { reset(); }
+
+/**
+ * Start a new, empty block in the buffer.
+ */
+void TFminiPlusLogWriter::reset() {
+    _size = 0;
+    _count = 0;
+    _timestamp = 0;
+    _interval = 0;
+    _distance = 0;
+    _strength = 0;
+    _raw_temperature = 0;
+
+    if (_capacity >= TFMINI_PLUS_LOG_HEADER_SIZE) {
+        _buffer[0] = TFMINI_PLUS_LOG_BLOCK_MARKER;
+        _buffer[1] = 0;
+        _size = TFMINI_PLUS_LOG_HEADER_SIZE;
+    }
+}
+
+/**
+ * Add a frame to the block.
+ *
+ * @param data: Frame to log.
+ * @return: True if the frame was added; false if the block is full and should be flushed and reset.
+ */
+bool TFminiPlusLogWriter::write(const tfminiplus_data_t &data) {
+    if (_size < TFMINI_PLUS_LOG_HEADER_SIZE or _count == TFMINI_PLUS_LOG_MAX_SAMPLES) return false;
+
+    // The temperature is an exact function of the raw value, so it can be recovered
+    uint16_t raw_temperature = tfminiplus_raw_temperature(data.temperature);
+
+    uint32_t interval = data.timestamp - _timestamp;
+    uint32_t interval_change = zigzag_encode(int32_t(interval - _interval));
+    uint32_t distance_change = zigzag_encode(int32_t(data.distance) - _distance);
+
+    // Only the fields that changed follow the tag; a small distance change is held in the tag itself
+    uint8_t sample[TFMINI_PLUS_LOG_MAX_SAMPLE_SIZE];
+    uint8_t tag = 0;
+    uint8_t length = 1;
+    if (interval_change) {
+        tag |= TFMINI_PLUS_LOG_INTERVAL_CHANGED;
+        length += write_varint(&sample[length], interval_change);
+    }
+    if (distance_change < TFMINI_PLUS_LOG_DISTANCE_ESCAPE) {
+        tag |= uint8_t(distance_change << TFMINI_PLUS_LOG_DISTANCE_SHIFT);
+    } else {
+        tag |= TFMINI_PLUS_LOG_DISTANCE_ESCAPE << TFMINI_PLUS_LOG_DISTANCE_SHIFT;
+        length += write_varint(&sample[length], distance_change - TFMINI_PLUS_LOG_DISTANCE_ESCAPE);
+    }
+    if (data.strength != _strength) {
+        tag |= TFMINI_PLUS_LOG_STRENGTH_CHANGED;
+        length += write_varint(&sample[length], zigzag_encode(int32_t(data.strength) - _strength));
+    }
+    if (raw_temperature != _raw_temperature) {
+        tag |= TFMINI_PLUS_LOG_TEMPERATURE_CHANGED;
+        length += write_varint(&sample[length], zigzag_encode(int32_t(raw_temperature) - _raw_temperature));
+    }
+    sample[0] = tag;
+    if (_size + length > _capacity) return false;
+
+    memcpy(&_buffer[_size], sample, length);
+    _size += length;
+    _buffer[1] = ++_count;
+
+    _timestamp = data.timestamp;
+    _interval = interval;
+    _distance = data.distance;
+    _strength = data.strength;
+    _raw_temperature = raw_temperature;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Reader for a log block.
+ *
+ * @param block: Start of the block.
+ * @param size: Number of bytes available from the start of the block.
+ */
+TFminiPlusLogReader::TFminiPlusLogReader(const uint8_t *block, size_t size)
+    : _block(block), _size(size), _position(TFMINI_PLUS_LOG_HEADER_SIZE), _timestamp(0), _interval(0), _distance(0), _strength(0), _raw_temperature(0) {
+    _remaining = get_sample_count();
+}
+
+/**
+ * Check if the data starts with a log block.
+ *
+ * @return: True if the block marker is present.
+ */
+bool TFminiPlusLogReader::is_valid() const { return _size >= TFMINI_PLUS_LOG_HEADER_SIZE and _block[0] == TFMINI_PLUS_LOG_BLOCK_MARKER; }
+
+/**
+ * Get the number of samples stored in the block.
+ *
+ * @return: Sample count, or 0 if the block is not valid.
+ */
+uint8_t TFminiPlusLogReader::get_sample_count() const { return is_valid() ? _block[1] : 0; }
+
+/**
+ * Get the size of the block, so the next block in a stream can be found.
+ * Only known once every sample has been read.
+ *
+ * @return: Number of bytes in the block, or 0 if samples remain unread.
+ */
+size_t TFminiPlusLogReader::get_block_size() { return (is_valid() and _remaining == 0) ? _position : 0; }
+
+/**
+ * Decode the next frame in the block.
+ *
+ * @param data: Container for the decoded frame.
+ * @return: True if a frame was decoded; false at the end of the block or if it is truncated.
+ */
+bool TFminiPlusLogReader::read(tfminiplus_data_t &data) {
+    if (_remaining == 0) return false;
+
+    // Fields left out of the sample did not change
+    uint32_t interval_change = 0, distance_change = 0, strength_change = 0, temperature_change = 0;
+    bool complete = _position < _size;
+    uint8_t tag = complete ? _block[_position++] : 0;
+    if (complete and (tag & TFMINI_PLUS_LOG_INTERVAL_CHANGED)) complete = read_varint(interval_change);
+
+    distance_change = tag >> TFMINI_PLUS_LOG_DISTANCE_SHIFT;
+    if (complete and distance_change == TFMINI_PLUS_LOG_DISTANCE_ESCAPE) {
+        complete = read_varint(distance_change);
+        distance_change += TFMINI_PLUS_LOG_DISTANCE_ESCAPE;
+    }
+    if (complete and (tag & TFMINI_PLUS_LOG_STRENGTH_CHANGED)) complete = read_varint(strength_change);
+    if (complete and (tag & TFMINI_PLUS_LOG_TEMPERATURE_CHANGED)) complete = read_varint(temperature_change);
+    if (not complete) {
+        _remaining = 0;
+        return false;
+    }
+
+    _interval += zigzag_decode(interval_change);
+    _timestamp += _interval;
+    _distance += zigzag_decode(distance_change);
+    _strength += zigzag_decode(strength_change);
+    _raw_temperature += zigzag_decode(temperature_change);
+    _remaining--;
+
+    data.distance = _distance;
+    data.strength = _strength;
+    data.temperature = tfminiplus_convert_temperature(_raw_temperature);
+    data.timestamp = _timestamp;
+    data.sample_time = _timestamp;
+    data.flags = 0;
+    return true;
+}
+
+/**
+ * Read a varint from the block.
+ *
+ * @param value: Decoded value.
+ * @return: True if a complete varint was read.
+ */
+bool TFminiPlusLogReader::read_varint(uint32_t &value) {
+    value = 0;
+    for (uint8_t shift = 0; shift < 35 and _position < _size; shift += 7) {
+        uint8_t c = _block[_position++];
+        value |= uint32_t(c & 0x7F) << shift;
+        if (not(c & 0x80)) return true;
+    }
+    return false;
+}
@@ -0,0 +1,101 @@
+#ifndef TF_MINI_PLUS_LOG_H
+#define TF_MINI_PLUS_LOG_H
+
+#include <TFmini_plus.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+const uint8_t TFMINI_PLUS_LOG_BLOCK_MARKER = 0xA5;
+const uint8_t TFMINI_PLUS_LOG_HEADER_SIZE = 2;
+const uint8_t TFMINI_PLUS_LOG_MAX_SAMPLE_SIZE = 15;  // Largest encoded sample: 1 + 5 + 3 + 3 + 3 bytes
+const uint8_t TFMINI_PLUS_LOG_MAX_SAMPLES = 255;
+
+// Sample tag layout
+const uint8_t TFMINI_PLUS_LOG_INTERVAL_CHANGED = 0x01;
+const uint8_t TFMINI_PLUS_LOG_STRENGTH_CHANGED = 0x02;
+const uint8_t TFMINI_PLUS_LOG_TEMPERATURE_CHANGED = 0x04;
+const uint8_t TFMINI_PLUS_LOG_DISTANCE_SHIFT = 3;
+const uint8_t TFMINI_PLUS_LOG_DISTANCE_ESCAPE = 31;  // Distance change does not fit in the tag; a varint follows
+
+/**
+ * Compact log of data frames, written in self-contained blocks.
+ * Each block is:
+ * [0] 0xA5 - Block marker
+ * [1] Number of samples in the block
+ * [2-n] Samples
+ *
+ * Each sample starts with a tag byte:
+ * [bit 0] The interval between timestamps changed
+ * [bit 1] The strength changed
+ * [bit 2] The raw temperature changed
+ * [bits 3-7] Zigzag-encoded change in distance, or 31 if it did not fit
+ * followed by zigzag varints for whichever of these are present, in order: the change in the
+ * timestamp interval in us, the distance change less 31, and the changes in strength and raw
+ * temperature. A frame period that holds steady and fields that do not change cost nothing beyond
+ * the tag. The first sample of a block is stored as a change from zero, so blocks can be decoded
+ * on their own even if earlier ones were lost.
+ *
+ * A steady 1000Hz stream of an unchanging target takes 1 to 2 bytes per sample, depending on
+ * timestamp jitter. A noisy one takes about 4 bytes per sample, as strength changes every frame;
+ * see the README.
+ *
+ * Example:
+ *  uint8_t block[128];
+ *  TFminiPlusLogWriter log(block, sizeof(block));
+ *  if (not log.write(data)) {
+ *      sd.write(log.get_block(), log.get_size());
+ *      log.reset();
+ *      log.write(data);
+ *  }
+ */
+class TFminiPlusLogWriter {
+   public:
+    TFminiPlusLogWriter(uint8_t *buffer, size_t size);
+
+    bool write(const tfminiplus_data_t &data);
+    void reset();
+
+    const uint8_t *get_block() const { return _buffer; }
+    size_t get_size() const { return _size; }
+    uint8_t get_sample_count() const { return _count; }
+
+   private:
+    uint8_t *_buffer;
+    size_t _capacity;
+    size_t _size;
+    uint8_t _count;
+    uint32_t _timestamp;
+    uint32_t _interval;
+    uint16_t _distance;
+    uint16_t _strength;
+    uint16_t _raw_temperature;
+};
+
+/**
+ * Decoder for one block written by TFminiPlusLogWriter.
+ * Decoded frames have sample_time equal to timestamp and no flags, as neither is logged.
+ */
+class TFminiPlusLogReader {
+   public:
+    TFminiPlusLogReader(const uint8_t *block, size_t size);
+
+    bool is_valid() const;
+    uint8_t get_sample_count() const;
+    size_t get_block_size();
+    bool read(tfminiplus_data_t &data);
+
+   private:
+    const uint8_t *_block;
+    size_t _size;
+    size_t _position;
+    uint8_t _remaining;
+    uint32_t _timestamp;
+    uint32_t _interval;
+    uint16_t _distance;
+    uint16_t _strength;
+    uint16_t _raw_temperature;
+
+    bool read_varint(uint32_t &value);
+};
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef TF_MINI_PLUS_TRANSPORT_H
+#define TF_MINI_PLUS_TRANSPORT_H
+
+#include <TFmini_plus.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Transport categories, used to pick the receive path at compile time
+struct tfminiplus_streaming_tag {};
+struct tfminiplus_packet_tag {};
+
+/**
+ * UART transport policy.
+ * SerialT is the concrete serial class (eg. HardwareSerial), so its methods can be inlined.
+ */
+template <class SerialT>
+class TFminiPlusUartTransport {
+   public:
+    typedef tfminiplus_streaming_tag category;
+
+    TFminiPlusUartTransport(SerialT &serial) : _serial(serial) {}
+
+    bool send(const uint8_t *input, uint8_t size) { return _serial.write(input, size) == size; }
+    int available() { return _serial.available(); }
+    int read() { return _serial.read(); }
+
+   private:
+    SerialT &_serial;
+};
+
+/**
+ * I2C transport policy.
+ * WireT is the concrete bus class (eg. TwoWire), so its methods can be inlined.
+ */
+template <class WireT>
+class TFminiPlusI2cTransport {
+   public:
+    typedef tfminiplus_packet_tag category;
+
+    TFminiPlusI2cTransport(WireT &wire, uint8_t address = 0x10) : _wire(wire), _address(address & 0x7F) {}
+
+    bool send(const uint8_t *input, uint8_t size) {
+        _wire.beginTransmission(_address);
+        uint8_t bytes_sent = _wire.write(input, size);
+        uint8_t error = _wire.endTransmission(true);
+        return (bytes_sent == size and not error);
+    }
+
+    uint8_t receive(uint8_t *output, uint8_t size) {
+        _wire.requestFrom(_address, size, true);
+
+        uint8_t bytes_read = 0;
+        while (bytes_read < size and _wire.available()) output[bytes_read++] = _wire.read();
+        return bytes_read;
+    }
+
+   private:
+    WireT &_wire;
+    uint8_t _address;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Lidar driver specialised for a single transport at compile time.
+ * Only the data path and generic command execution are provided; use TFminiPlus where the
+ * transport has to be chosen at runtime or the full configuration API is needed.
+ * Packets, response checks, timeouts, latency learning, and timestamps follow the same rules as TFminiPlus.
+ *
+ * Example:
+ *  TFminiPlusT<TFminiPlusUartTransport<HardwareSerial> > lidar(Serial1);
+ *  TFminiPlusT<TFminiPlusI2cTransport<TwoWire> > lidar(TFminiPlusI2cTransport<TwoWire>(Wire, 0x10));
+ */
+template <class Transport>
+class TFminiPlusT {
+   public:
+    TFminiPlusT(const Transport &transport)
+        : _transport(transport), _last_send_time(0), _header_time(0), _frame_time(0),
+          _sample_offset(tfminiplus_get_sample_offset(TFMINI_PLUS_DEFAULT_FRAMERATE)) {
+        _latency.reset();
+    }
+
+    /**
+     * Send a command packet to the lidar.
+     *
+     * @param command: 8-bit command to send; see TFMINI_PLUS_COMMANDS.
+     * @param arguments: Container containing the command arguments in little-endian format.
+     * @param size: Total number of bytes to send, including header and checksum.
+     * @return: True if the transmission was successful.
+     */
+    bool send_command(tfminiplus_command_t command, const uint8_t *arguments = 0, uint8_t size = TFMINI_PLUS_MINIMUM_PACKET_SIZE) {
+        if (size < TFMINI_PLUS_MINIMUM_PACKET_SIZE or size > TFMINI_PLUS_MAXIMUM_PACKET_SIZE) return false;
+
+        uint8_t packet[TFMINI_PLUS_MAXIMUM_PACKET_SIZE];
+        tfminiplus_build_packet(packet, command, arguments, size);
+        return send(packet, size);
+    }
+
+    /**
+     * Send a command and wait for its response.
+     *
+     * @param command: 8-bit command to send; see TFMINI_PLUS_COMMANDS.
+     * @param arguments: Container containing the command arguments in little-endian format.
+     * @param size: Total number of bytes to send, including header and checksum.
+     * @param response: Container for the response.
+     * @param response_size: Number of bytes expected in the response.
+     * @return: True if a response with a valid header, command code, and checksum was received.
+     */
+    bool execute_command(tfminiplus_command_t command, const uint8_t *arguments, uint8_t size, uint8_t *response, uint8_t response_size) {
+        return send_command(command, arguments, size) and receive_response(response, response_size, command, typename Transport::category());
+    }
+
+    /**
+     * Set the framerate of the lidar. Changes will not take effect until settings have been saved.
+     * The new framerate is also used to estimate sample times.
+     *
+     * @param framerate: Framerate to set the lidar to in Hz.
+     * @return: True if the framerate was echoed back correctly.
+     */
+    bool set_framerate(tfminiplus_framerate_t framerate) {
+        const tfminiplus_packet_t<TFMINI_PLUS_PACK_LENGTH_SET_FRAME_RATE> packet = tfminiplus_make_packet_u16(TFMINI_PLUS_SET_FRAME_RATE, framerate);
+        uint8_t response[TFMINI_PLUS_PACK_LENGTH_SET_FRAME_RATE];
+
+        // The lidar echoes the whole packet back when it accepts the framerate
+        bool result = execute_packet(packet, response, sizeof(response)) and memcmp(response, packet.data, sizeof(response)) == 0;
+        if (result) _sample_offset = tfminiplus_get_sample_offset(framerate);
+        return result;
+    }
+
+    /**
+     * Apply written settings to the lidar.
+     *
+     * @return: True if the settings were saved successfully.
+     */
+    bool save_settings() {
+        uint8_t response[TFMINI_PLUS_PACK_LENGTH_SAVE_SETTINGS_RESPONSE];
+        return execute_packet(TFMINI_PLUS_PACKET_SAVE_SETTINGS, response, sizeof(response)) and response[3] == 0;
+    }
+
+    /**
+     * Request the lidar to do a manual read.
+     */
+    void trigger_manual_reading() { send(TFMINI_PLUS_PACKET_TRIGGER_DETECTION.data, sizeof(TFMINI_PLUS_PACKET_TRIGGER_DETECTION.data)); }
+
+    /**
+     * Check for a data frame without blocking (UART only; does not compile for I2C transports).
+     *
+     * @param frame: View to point at the received frame. Valid until the next call.
+     * @return: True if a complete, valid data frame was received.
+     */
+    bool poll_frame(TFminiPlusFrame &frame) {
+        while (_transport.available() > 0) {
+            tfminiplus_frame_type_t frame_type = _parser.parse(_transport.read());
+            if (_parser.get_received_count() == 1) _header_time = micros();
+            if (frame_type != TFMINI_PLUS_FRAME_DATA) continue;
+
+            _frame_time = _header_time;
+            frame = TFminiPlusFrame(_parser.get_frame());
+            if (frame.is_valid()) return true;
+        }
+        return false;
+    }
+
+    /**
+     * Read a data frame from the lidar.
+     * UART frames are waited for; I2C frames are requested and then polled for.
+     *
+     * @param data: Data container to read output frame into.
+     * @param in_mm_format: True to request the data frame in mm units (I2C only).
+     * @return: True if the data frame was received successfully.
+     */
+    bool read_data(tfminiplus_data_t &data, bool in_mm_format = true) {
+        TFminiPlusFrame frame;
+        if (not read_frame(frame, in_mm_format, typename Transport::category())) return false;
+
+        data.distance = frame.get_distance();
+        data.strength = frame.get_strength();
+        data.temperature = frame.get_temperature();
+        data.timestamp = _frame_time;
+        data.sample_time = _frame_time - _sample_offset;
+        data.flags = 0;
+        return true;
+    }
+
+   private:
+    Transport _transport;
+    TFminiPlusParser _parser;
+    TFminiPlusLatency _latency;
+    unsigned long _last_send_time;
+    uint32_t _header_time;
+    uint32_t _frame_time;
+    uint32_t _sample_offset;
+    uint8_t _frame[TFMINI_PLUS_PACK_LENGTH_DATA_RESPONSE];
+
+    bool send(const uint8_t *input, uint8_t size) {
+        bool result = _transport.send(input, size);
+        _last_send_time = millis();
+        return result;
+    }
+
+    template <uint8_t N>
+    bool execute_packet(const tfminiplus_packet_t<N> &packet, uint8_t *response, uint8_t response_size) {
+        tfminiplus_command_t command = tfminiplus_command_t(packet.data[TFMINI_PLUS_PACKET_POS_COMMAND]);
+        return send(packet.data, N) and receive_response(response, response_size, command, typename Transport::category());
+    }
+
+    bool read_frame(TFminiPlusFrame &frame, bool, tfminiplus_streaming_tag) {
+        unsigned long start_time = millis();
+        while ((millis() - start_time) < TFMINI_PLUS_DATA_TIMEOUT) {
+            if (poll_frame(frame)) return true;
+        }
+        return false;
+    }
+
+    bool read_frame(TFminiPlusFrame &frame, bool in_mm_format, tfminiplus_packet_tag tag) {
+        const tfminiplus_packet_t<TFMINI_PLUS_PACK_LENGTH_GET_DATA> &request = in_mm_format ? TFMINI_PLUS_PACKET_GET_DATA_MM : TFMINI_PLUS_PACKET_GET_DATA_CM;
+        if (not send(request.data, sizeof(request.data))) return false;
+        if (not receive_response(_frame, sizeof(_frame), TFMINI_PLUS_GET_DATA, tag)) return false;
+
+        _frame_time = micros();
+        frame = TFminiPlusFrame(_frame);
+        return frame.is_valid();
+    }
+
+    bool receive_response(uint8_t *output, uint8_t size, tfminiplus_command_t command, tfminiplus_streaming_tag) {
+        unsigned long timeout = tfminiplus_get_response_timeout(command);
+
+        // Data frames in between are skipped; only a matching response ends the wait
+        while ((millis() - _last_send_time) < timeout) {
+            if (_transport.available() > 0 and _parser.parse(_transport.read()) == TFMINI_PLUS_FRAME_RESPONSE) {
+                const uint8_t *frame = _parser.get_frame();
+                if (_parser.get_frame_length() == size and tfminiplus_is_response_for(frame, size, command)) {
+                    memcpy(output, frame, size);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool receive_response(uint8_t *output, uint8_t size, tfminiplus_command_t command, tfminiplus_packet_tag) {
+        unsigned long timeout = tfminiplus_get_response_timeout(command);
+        unsigned long interval = TFMINI_PLUS_I2C_POLL_INTERVAL_MIN;
+        unsigned long first_poll = _latency.get_first_poll_delay(command);
+        bool first_attempt = true;
+
+        unsigned long elapsed = millis() - _last_send_time;
+        if (elapsed < first_poll) delay(first_poll - elapsed);
+
+        while (true) {
+            if (_transport.receive(output, size) == size and tfminiplus_compare_checksum(output, size) and
+                tfminiplus_is_response_for(output, size, command)) {
+                _latency.record_response(command, millis() - _last_send_time, first_attempt);
+                return true;
+            }
+            if ((millis() - _last_send_time) >= timeout) return false;
+            first_attempt = false;
+
+            delay(interval);
+            if (interval < TFMINI_PLUS_I2C_POLL_INTERVAL_MAX) interval <<= 1;
+        }
+    }
+};
+
+#endif